@@ -28,10 +28,10 @@ elseif ("${CMAKE_CXX_COMPILER_ID}" MATCHES "Clang")
 
 elseif ("${CMAKE_CXX_COMPILER_ID}" STREQUAL "MSVC")
 
-    # declare Windows Vista requirement
+    # declare Windows 7 requirement, for the processor group functions
     # undefine windows.h MAX & MIN macros because they conflict with std::min & std::max functions
     # disable unsafe CRT Library functions warnings
-    add_definitions(/D_WIN32_WINNT=0x0600 /DNOMINMAX /D_CRT_SECURE_NO_WARNINGS /D_SILENCE_CXX17_ALLOCATOR_VOID_DEPRECATION_WARNING)
+    add_definitions(/D_WIN32_WINNT=0x0601 /DNOMINMAX /D_CRT_SECURE_NO_WARNINGS /D_SILENCE_CXX17_ALLOCATOR_VOID_DEPRECATION_WARNING)
 
     # enable parallel compilation
     # specify Exception Handling Model
@@ -18,6 +18,7 @@
 #include <string>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/function.hpp>
 #include <boost/program_options.hpp>
 
@@ -33,10 +34,15 @@
 #include <libeth/Farm.h>
 #if ETH_ETHASHCL
 #include <libcl/CLMiner.h>
+#include <libcl/CLProfileStore.h>
+#include <libcl/CLProgramCache.h>
 #endif
 #if ETH_ETHASHCUDA
 #include <libcuda/CUDAMiner.h>
 #endif
+#if ETH_ETHASHCPU
+#include <libcpu/CPUMiner.h>
+#endif
 #include <libpool/PoolManager.h>
 
 #if API_CORE
@@ -44,6 +50,7 @@
 #include <regex>
 #endif
 
+#include <ethash/ethash.h>
 #include <ethash/version.h>
 
 using namespace std;
@@ -54,9 +61,7 @@ using namespace boost::program_options;
 
 // Global vars
 bool g_running = false;
-bool g_seqDAG = false;
 bool g_exitOnError = false; // Whether or not miner should exit on mining threads errors
-mutex g_seqDAGMutex;
 
 condition_variable g_shouldstop;
 boost::asio::io_service g_io_service; // The IO service itself
@@ -179,6 +184,12 @@ static void on_api_port(int i) {
 }
 #endif
 
+static void on_stale_risk(float r) {
+    if (r > 0 && r <= 50)
+        return;
+    throw boost::program_options::error("The --stale-risk value is out of range");
+}
+
 #if ETH_ETHASHCUDA
 static void on_cu_block_size(unsigned b) {
     if (b == 32 || b == 64 || b == 128 || b == 256)
@@ -193,6 +204,14 @@ static void on_cu_streams(unsigned s) {
 }
 #endif
 
+#if ETH_ETHASHCPU
+static void on_cp_numa(string p) {
+    if (p == "replicate" || p == "interleave" || p == "off")
+        return;
+    throw boost::program_options::error("The --cp-numa value must be replicate, interleave or off");
+}
+#endif
+
 #if ETH_ETHASHCL
 static void on_cl_local_work(unsigned b) {
     if (b == 64 || b == 128 || b == 256)
@@ -229,7 +248,7 @@ class MinerCLI {
         if (!ec && g_running) {
             if (g_logOptions & LOG_MULTI) {
                 list<string> vs;
-                Farm::f().Telemetry().strvec(vs);
+                Farm::f().Telemetry()->strvec(vs);
                 string s(vs.front());
                 vs.pop_front();
                 while (!vs.empty()) {
@@ -237,7 +256,7 @@ class MinerCLI {
                     vs.pop_front();
                 }
             } else
-                cnote << Farm::f().Telemetry().str();
+                cnote << Farm::f().Telemetry()->str();
             // Restart timer
             m_cliDisplayTimer.expires_from_now(boost::posix_time::seconds(m_cliDisplayInterval));
             m_cliDisplayTimer.async_wait(m_io_strand.wrap(
@@ -324,7 +343,7 @@ class MinerCLI {
 
     bool validateArgs(int argc, char** argv) {
         queue<string> warnings;
-        bool cl_miner, cuda_miner;
+        bool cl_miner, cuda_miner, cpu_miner;
         vector<string> pools;
 
         options_description general("General options");
@@ -336,6 +355,9 @@ class MinerCLI {
 #if ETH_ETHASHCUDA
         options_description cu("CUDA options");
 #endif
+#if ETH_ETHASHCPU
+        options_description cp("CPU options");
+#endif
 #if API_CORE
         options_description api("API options");
 #endif
@@ -354,6 +376,9 @@ class MinerCLI {
 #if ETH_ETHASHCUDA
                 "cu, "
 #endif
+#if ETH_ETHASHCPU
+                "cp, "
+#endif
 #if API_CORE
                 "api, "
 #endif
@@ -387,6 +412,11 @@ class MinerCLI {
             ("cuda,U",
 
                 "Mine/Benchmark using CUDA only")
+#endif
+#if ETH_ETHASHCPU
+            ("cpu",
+
+                "Mine/Benchmark using CPU only")
 #endif
             ;
 
@@ -467,12 +497,26 @@ class MinerCLI {
                 "Use syslog appropriate output (drop timestamp "
                 "and channel prefix)")
 
-#if ETH_ETHASHCL || ETH_ETHASHCUDA
+            ("dag-dir", value<string>(),
+
+                "Directory where light caches and CPU DAGs are kept "
+                "between runs. Defaults to $XDG_CACHE_HOME/etcminer "
+                "or ~/.cache/etcminer, %LOCALAPPDATA%\\etcminer on Windows")
+
+            ("no-dag-store",
+
+                "Do not keep light caches and CPU DAGs on disk")
+
+            ("dag-verify",
+
+                "Check the CPU DAGs read from disk against their checksum. Reads the whole DAG at each load")
+
+#if ETH_ETHASHCL || ETH_ETHASHCUDA || ETH_ETHASHCPU
 
             ("list-devices,L",
 
-                "Lists the detected OpenCL/CUDA devices and "
-                "exits. Can be combined with -G or -U flags")
+                "Lists the detected OpenCL/CUDA/CPU devices and "
+                "exits. Can be combined with -G, -U or --cpu flags")
 #endif
             ("tstop", value<unsigned>()->default_value(0),
 
@@ -498,7 +542,18 @@ class MinerCLI {
 
             ("seq",
 
-                "Generate DAG sequentially, one GPU at a time.");
+                "Generate DAG sequentially, one GPU at a time. Same as --dag-slots 1.")
+
+            ("dag-slots", value<unsigned>()->default_value(0),
+
+                "Set how many devices may generate their DAG at the same time, "
+                "fastest first. 0 lets them all generate at once.")
+
+            ("stale-risk", value<float>()->default_value(BATCH_STALE_RISK * 100)->notifier(on_stale_risk),
+
+                "Set the percentage of hashing allowed to go stale on job switches, up to 50. "
+                "Batches get shorter the faster jobs arrive, down to the backend's "
+                "launch overhead bound.");
 
 #if API_CORE
 
@@ -541,7 +596,51 @@ class MinerCLI {
 
             ("cl-split",
 
-                "Force split-DAG mode. May improve performance on older GPU models.");
+                "Force split-DAG mode, at least two DAG buffers. May improve performance on older GPU models. "
+                "The DAG is split further whenever it exceeds the largest allocation the device allows.")
+
+            ("cl-cache-dir", value<string>(),
+
+                "Directory where compiled OpenCL kernels are kept between runs. "
+                "Defaults to $XDG_CACHE_HOME/etcminer/cl or ~/.cache/etcminer/cl, "
+                "%LOCALAPPDATA%\\etcminer\\cl on Windows")
+
+            ("no-cl-cache",
+
+                "Compile the OpenCL kernel at each epoch change and restart")
+
+            ("cl-autotune",
+
+                "Time the work group sizes, batch sizes and split DAG on the first epoch and keep the fastest. "
+                "The result is stored per device and driver and used by later runs unless --cl-work or "
+                "--cl-split is given")
+
+            ("cl-host-dag", value<vector<unsigned>>()->multitoken()->zero_tokens(),
+
+                "Generate the DAG once on the host, using every core, and stream it to the listed "
+                "devices instead of generating it on each of them. Without a list, applies to all the "
+                "OpenCL devices. Needs host memory for a whole DAG")
+
+            ("cl-profile-dir", value<string>(),
+
+                "Directory where tuned OpenCL settings are kept. "
+                "Defaults to $XDG_CONFIG_HOME/etcminer/cl or ~/.config/etcminer/cl, "
+                "%LOCALAPPDATA%\\etcminer\\cl on Windows");
+#endif
+#if ETH_ETHASHCPU
+        cp.add_options()
+
+            ("cp-threads", value<unsigned>()->default_value(0),
+
+                "Set the number of CPU mining threads, one per core. "
+                "0 uses every online core")
+
+            ("cp-numa", value<string>()->default_value("replicate")->notifier(on_cp_numa),
+
+                "Set the DAG placement on NUMA hosts. replicate copies "
+                "the DAG to every node and hashes against the local "
+                "copy, interleave spreads one DAG across the nodes, "
+                "off leaves the placement to the system");
 #endif
         test.add_options()
 
@@ -703,6 +802,10 @@ class MinerCLI {
             else if (s == "cu") // cuda
                 cout << endl << cu << endl;
 #endif
+#if ETH_ETHASHCPU
+            else if (s == "cp") // cpu
+                cout << endl << cp << endl;
+#endif
 #if API_CORE
             else if (s == "api") // programming interface
                 cout << endl << api << endl;
@@ -735,6 +838,10 @@ class MinerCLI {
                      << "    if requested via the API, or if the miner detects a hung\n"
                      << "    GPU. The script is invoked with 1 parameter, 'api_miner_reboot'\n"
                      << "    for API reboots, and 'hung_miner_reboot' for hung GPUs\n\n"
+                     << "    A GPU is hung when it completes no kernel for 10 batch\n"
+                     << "    times, and at least 2 seconds. The miner kicks it, then\n"
+                     << "    reinitializes it, then restarts mining, each after as long\n"
+                     << "    again, before running the script.\n\n"
                      << "    The script needs a specific file name and must be first in\n"
                      << "    the search path.\n\n"
                      << "    For Linux:   reboot.sh\n\n"
@@ -746,7 +853,8 @@ class MinerCLI {
         g_logNoColor = vm.count("nocolor");
         g_logSyslog = vm.count("syslog");
         g_exitOnError = vm.count("exit");
-        g_seqDAG = vm.count("seq");
+        m_FarmSettings.dagSlots = vm.count("seq") ? 1 : vm["dag-slots"].as<unsigned>();
+        m_FarmSettings.staleRisk = vm["stale-risk"].as<float>() / 100;
 
         m_PoolSettings.getWorkPollInterval = vm["getwork-recheck"].as<unsigned>();
         m_PoolSettings.connectionMaxRetries = vm["retry-max"].as<unsigned>();
@@ -782,13 +890,63 @@ class MinerCLI {
 #if ETH_ETHASHCL
         m_FarmSettings.clGroupSize = vm["cl-work"].as<unsigned>();
         m_FarmSettings.clSplit = vm.count("cl-split");
+        m_FarmSettings.clProfile = vm["cl-work"].defaulted() && !vm.count("cl-split");
+        m_FarmSettings.clAutotune = vm.count("cl-autotune");
+        m_clHostDag = vm.count("cl-host-dag");
+        if (m_clHostDag)
+            m_clHostDagDevices = vm["cl-host-dag"].as<vector<unsigned>>();
+        if (vm.count("cl-profile-dir"))
+            m_clProfileDir = vm["cl-profile-dir"].as<string>();
+#if !defined(_WIN32)
+        else if (getenv("XDG_CONFIG_HOME"))
+            m_clProfileDir = string(getenv("XDG_CONFIG_HOME")) + "/etcminer/cl";
+        else if (getenv("HOME"))
+            m_clProfileDir = string(getenv("HOME")) + "/.config/etcminer/cl";
+#else
+        else if (getenv("LOCALAPPDATA"))
+            m_clProfileDir = string(getenv("LOCALAPPDATA")) + "\\etcminer\\cl";
 #endif
+        if (!vm.count("no-cl-cache")) {
+            if (vm.count("cl-cache-dir"))
+                m_clCacheDir = vm["cl-cache-dir"].as<string>();
+#if !defined(_WIN32)
+            else if (getenv("XDG_CACHE_HOME"))
+                m_clCacheDir = string(getenv("XDG_CACHE_HOME")) + "/etcminer/cl";
+            else if (getenv("HOME"))
+                m_clCacheDir = string(getenv("HOME")) + "/.cache/etcminer/cl";
+#else
+            else if (getenv("LOCALAPPDATA"))
+                m_clCacheDir = string(getenv("LOCALAPPDATA")) + "\\etcminer\\cl";
+#endif
+        }
+#endif
+
+#if ETH_ETHASHCPU
+        m_cpThreads = vm["cp-threads"].as<unsigned>();
+        m_cpNuma = vm["cp-numa"].as<string>();
+#endif
+
+        m_dagVerify = vm.count("dag-verify");
+        if (!vm.count("no-dag-store")) {
+            if (vm.count("dag-dir"))
+                m_dagStoreDir = vm["dag-dir"].as<string>();
+#if !defined(_WIN32)
+            else if (getenv("XDG_CACHE_HOME"))
+                m_dagStoreDir = string(getenv("XDG_CACHE_HOME")) + "/etcminer";
+            else if (getenv("HOME"))
+                m_dagStoreDir = string(getenv("HOME")) + "/.cache/etcminer";
+#else
+            else if (getenv("LOCALAPPDATA"))
+                m_dagStoreDir = string(getenv("LOCALAPPDATA")) + "\\etcminer";
+#endif
+        }
 
         m_FarmSettings.tempStop = vm["tstop"].as<unsigned>();
         m_FarmSettings.tempStart = vm["tstart"].as<unsigned>();
 
         cl_miner = vm.count("opencl");
         cuda_miner = vm.count("cuda");
+        cpu_miner = vm.count("cpu");
         if (vm.count("pool"))
             for (auto& p : vm["pool"].as<vector<string>>())
                 pools.push_back(p);
@@ -807,7 +965,9 @@ class MinerCLI {
         }
 #endif
 
-        if (cl_miner)
+        if (cpu_miner)
+            m_minerType = MinerType::CPU;
+        else if (cl_miner)
             m_minerType = MinerType::CL;
         else if (cuda_miner)
             m_minerType = MinerType::CUDA;
@@ -876,6 +1036,10 @@ class MinerCLI {
         if (m_minerType == MinerType::CUDA || m_minerType == MinerType::Mixed)
             CUDAMiner::enumDevices(m_DevicesCollection);
 #endif
+#if ETH_ETHASHCPU
+        if (m_minerType == MinerType::CPU)
+            CPUMiner::enumDevices(m_DevicesCollection);
+#endif
 
         // Can't proceed without any GPU
         if (!m_DevicesCollection.size())
@@ -934,6 +1098,9 @@ class MinerCLI {
                 case DeviceTypeEnum::Accelerator:
                     cout << "Acc";
                     break;
+                case DeviceTypeEnum::Cpu:
+                    cout << "Cpu";
+                    break;
                 default:
                     break;
                 }
@@ -976,9 +1143,29 @@ class MinerCLI {
                 if (!it->second.clDetected || it->second.subscriptionType != DeviceSubscriptionTypeEnum::None)
                     continue;
                 unsigned d = (unsigned)distance(m_DevicesCollection.begin(), it);
-                if (m_devices.empty() || find(m_devices.begin(), m_devices.end(), d) != m_devices.end())
+                if (m_devices.empty() || find(m_devices.begin(), m_devices.end(), d) != m_devices.end()) {
                     it->second.subscriptionType = DeviceSubscriptionTypeEnum::OpenCL;
+                    auto const& h = m_clHostDagDevices;
+                    it->second.clHostDag = m_clHostDag && (h.empty() || find(h.begin(), h.end(), d) != h.end());
+                }
             }
+#endif
+#if ETH_ETHASHCPU
+        if (m_minerType == MinerType::CPU) {
+            unsigned threads = 0;
+            for (auto it = m_DevicesCollection.begin(); it != m_DevicesCollection.end(); it++) {
+                if (!it->second.cpDetected || it->second.subscriptionType != DeviceSubscriptionTypeEnum::None)
+                    continue;
+                if (m_cpThreads && threads >= m_cpThreads)
+                    break;
+                unsigned d = (unsigned)distance(m_DevicesCollection.begin(), it);
+                if (m_devices.empty() || find(m_devices.begin(), m_devices.end(), d) != m_devices.end()) {
+                    it->second.subscriptionType = DeviceSubscriptionTypeEnum::Cpu;
+                    it->second.cpNumaReplicate = (m_cpNuma == "replicate");
+                    threads++;
+                }
+            }
+        }
 #endif
         // Count of subscribed devices
         int subscribedDevices = 0;
@@ -1000,6 +1187,37 @@ class MinerCLI {
         signal(SIGINT, MinerCLI::signalHandler);
         signal(SIGTERM, MinerCLI::signalHandler);
 
+#if ETH_ETHASHCPU
+        if (m_minerType == MinerType::CPU)
+            ethash_set_numa_interleave(m_cpNuma == "interleave");
+#endif
+
+        // Persistent light cache / DAG store
+        if (!m_dagStoreDir.empty()) {
+            boost::system::error_code ec;
+            boost::filesystem::create_directories(m_dagStoreDir, ec);
+            if (ec)
+                cwarn << "DAG store disabled, can't create " << m_dagStoreDir << " : " << ec.message();
+            else {
+                ethash_set_epoch_store_dir(m_dagStoreDir.c_str());
+                ethash_set_epoch_store_verify(m_dagVerify);
+            }
+        }
+
+#if ETH_ETHASHCL
+        // Compiled OpenCL kernels
+        if (!m_clCacheDir.empty()) {
+            boost::system::error_code ec;
+            boost::filesystem::create_directories(m_clCacheDir, ec);
+            if (ec)
+                cwarn << "OpenCL kernel cache disabled, can't create " << m_clCacheDir << " : " << ec.message();
+            else
+                CLProgramCache::setDir(m_clCacheDir);
+        }
+        // Tuned OpenCL settings, the directory is created once a profile is stored
+        CLProfileStore::setDir(m_clProfileDir);
+#endif
+
         // Initialize Farm
         new Farm(m_DevicesCollection, m_FarmSettings);
 
@@ -1060,6 +1278,8 @@ class MinerCLI {
     MinerType m_minerType = MinerType::Mixed;
     OperationMode m_mode = OperationMode::None;
     bool m_shouldListDevices = false;
+    string m_dagStoreDir;     // Persistent light cache / DAG store, empty if disabled
+    bool m_dagVerify = false; // Checksum the stored DAGs on load
 
     FarmSettings m_FarmSettings; // Operating settings for Farm
     PoolSettings m_PoolSettings; // Operating settings for PoolManager
@@ -1072,6 +1292,18 @@ class MinerCLI {
 
     vector<unsigned> m_devices;
 
+#if ETH_ETHASHCL
+    string m_clCacheDir;   // Compiled OpenCL kernels, empty if disabled
+    string m_clProfileDir; // Tuned OpenCL settings, empty if disabled
+    bool m_clHostDag = false;
+    vector<unsigned> m_clHostDagDevices; // Empty for all
+#endif
+
+#if ETH_ETHASHCPU
+    unsigned m_cpThreads = 0; // Number of CPU mining threads (0 = all cores)
+    string m_cpNuma;          // DAG placement on NUMA hosts (replicate, interleave, off)
+#endif
+
     bool m_bench = false;
 
 #if API_CORE
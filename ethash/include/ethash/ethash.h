@@ -58,7 +58,8 @@ struct ethash_result
  * Calculates the number of items in the light cache for given epoch.
  *
  * This function will search for a prime number matching the criteria given
- * by the Ethash so the execution time is not constant. It takes ~ 0.01 ms.
+ * by the Ethash so the execution time is not constant. It takes ~ 0.01 ms,
+ * the result is kept for the epochs the seed index covers.
  *
  * @param epoch_number  The epoch number.
  * @return              The number items in the light cache.
@@ -70,7 +71,8 @@ int ethash_calculate_light_cache_num_items(int epoch_number) NOEXCEPT;
  * Calculates the number of items in the full dataset for given epoch.
  *
  * This function will search for a prime number matching the criteria given
- * by the Ethash so the execution time is not constant. It takes ~ 0.05 ms.
+ * by the Ethash so the execution time is not constant. It takes ~ 0.05 ms,
+ * the result is kept for the epochs the seed index covers.
  *
  * @param epoch_number  The epoch number.
  * @return              The number items in the full dataset.
@@ -79,6 +81,9 @@ int ethash_calculate_full_dataset_num_items(int epoch_number) NOEXCEPT;
 
 /**
  * Calculates the epoch seed hash.
+ *
+ * The seeds of the first 30000 epochs are looked up in an index built on first use.
+ *
  * @param epoch_number  The epoch number.
  * @return              The epoch seed hash.
  */
@@ -92,6 +97,7 @@ struct ethash_epoch_context* ethash_create_epoch_context(int epoch_number) NOEXC
  *
  * The memory for the full dataset is only allocated and marked as "not-generated".
  * The items of the full dataset are generated on the fly when hit for the first time.
+ * The context may be used by many hashing threads at once.
  *
  * The memory allocated in the context MUST be freed with ethash_destroy_epoch_context_full().
  *
@@ -100,6 +106,80 @@ struct ethash_epoch_context* ethash_create_epoch_context(int epoch_number) NOEXC
  */
 struct ethash_epoch_context_full* ethash_create_epoch_context_full(int epoch_number) NOEXCEPT;
 
+/**
+ * Progress callback of the full dataset generation.
+ *
+ * @param items_done   The number of full dataset items generated so far.
+ * @param items_total  The number of items in the full dataset.
+ * @param user_data    The user data pointer passed to the generating function.
+ * @return  false to cancel the generation.
+ */
+typedef bool (*ethash_dataset_progress_fn)(int items_done, int items_total, void* user_data);
+
+/**
+ * Creates the epoch context with the full dataset generated ahead of time.
+ *
+ * The full dataset items are computed in parallel by @p num_threads threads, the
+ * calling thread included. The progress callback is invoked from the calling
+ * thread only and may cancel the generation by returning false.
+ *
+ * The memory allocated in the context MUST be freed with ethash_destroy_epoch_context_full().
+ *
+ * @param epoch_number  The epoch number.
+ * @param num_threads   The number of generating threads, 0 for one per hardware thread.
+ * @param progress      The optional progress callback, may be null.
+ * @param user_data     The pointer passed back to the progress callback.
+ * @return  Pointer to the context or null in case of memory allocation failure or cancellation.
+ */
+struct ethash_epoch_context_full* ethash_generate_epoch_context_full(int epoch_number,
+    unsigned num_threads, ethash_dataset_progress_fn progress, void* user_data) NOEXCEPT;
+
+/**
+ * Generates the items [begin, end) of the full dataset of the context.
+ *
+ * Safe to call from many threads at once and while the context is used for
+ * hashing: the items generated already, by lazy lookups or by other calls, are
+ * not computed again. Returns once all the items of the range are generated.
+ *
+ * @param context  The epoch context with the full dataset.
+ * @param begin    The first item to generate.
+ * @param end      The item after the last one to generate, clamped to the dataset size.
+ */
+void ethash_generate_full_dataset_items(
+    const struct ethash_epoch_context_full* context, int begin, int end) NOEXCEPT;
+
+/**
+ * Returns the full dataset of the context.
+ *
+ * Only the items generated so far hold their value, see
+ * ethash_generate_full_dataset_items().
+ */
+const union ethash_hash1024* ethash_get_full_dataset(
+    const struct ethash_epoch_context_full* context) NOEXCEPT;
+
+/**
+ * Creates a copy of the epoch context with the full dataset placed on the given NUMA node.
+ *
+ * The items of the full dataset not generated yet in the source context are computed
+ * again on demand in the copy. The placement is a preference, the memory falls back
+ * to the other nodes when the node is full. It only has effect on Linux.
+ *
+ * The memory allocated in the context MUST be freed with ethash_destroy_epoch_context_full().
+ *
+ * @param context    The epoch context with the full dataset to copy.
+ * @param numa_node  The preferred NUMA node, -1 for the default placement.
+ * @return  Pointer to the copy or null in case of memory allocation failure.
+ */
+struct ethash_epoch_context_full* ethash_copy_epoch_context_full(
+    const struct ethash_epoch_context_full* context, int numa_node) NOEXCEPT;
+
+/**
+ * Sets whether the epoch contexts created afterwards are interleaved across the NUMA nodes.
+ *
+ * Applies to the contexts without a preferred node, only on Linux. Disabled by default.
+ */
+void ethash_set_numa_interleave(bool interleave) NOEXCEPT;
+
 void ethash_destroy_epoch_context(struct ethash_epoch_context* context) NOEXCEPT;
 
 void ethash_destroy_epoch_context_full(struct ethash_epoch_context_full* context) NOEXCEPT;
@@ -116,6 +196,98 @@ const struct ethash_epoch_context* ethash_get_global_epoch_context(int epoch_num
 const struct ethash_epoch_context_full* ethash_get_global_epoch_context_full(
     int epoch_number) NOEXCEPT;
 
+/**
+ * Get global shared epoch context with full dataset generated.
+ *
+ * When the shared context has to be built it is created with
+ * ethash_generate_epoch_context_full() and the given generation parameters.
+ * A shared context created for lazy lookups is completed in place the same way.
+ * Returns null if the generation fails or is cancelled.
+ */
+const struct ethash_epoch_context_full* ethash_get_global_epoch_context_full_generated(
+    int epoch_number, unsigned num_threads, ethash_dataset_progress_fn progress,
+    void* user_data) NOEXCEPT;
+
+
+/**
+ * Get global shared epoch context if it is already built, without blocking.
+ *
+ * Returns null if the context is not cached or is still being built.
+ */
+const struct ethash_epoch_context* ethash_try_get_global_epoch_context(int epoch_number) NOEXCEPT;
+
+/**
+ * Get global shared epoch context with full dataset if it is already built, without blocking.
+ */
+const struct ethash_epoch_context_full* ethash_try_get_global_epoch_context_full(
+    int epoch_number) NOEXCEPT;
+
+/**
+ * Starts building the global shared epoch context in a background thread.
+ *
+ * Does nothing if the context is already cached or being built. Used to have the
+ * light cache of the next epoch ready before the epoch change.
+ */
+void ethash_prebuild_global_epoch_context(int epoch_number) NOEXCEPT;
+
+/**
+ * Sets how many global shared epoch contexts are kept.
+ *
+ * The least recently used contexts are dropped first. By default 4 contexts and
+ * 1 context with full dataset are kept.
+ *
+ * @param num_contexts       The number of contexts, at least 1.
+ * @param num_contexts_full  The number of contexts with full dataset, at least 1.
+ */
+void ethash_set_global_epoch_context_cache_size(
+    unsigned num_contexts, unsigned num_contexts_full) NOEXCEPT;
+
+/**
+ * Sets the directory of the on-disk epoch store used by the global shared contexts.
+ *
+ * When set, the light caches and the completely generated full datasets are
+ * written there as epoch-<n>.light and epoch-<n>.dag files with checksums, and
+ * later mapped read-only instead of being rebuilt. The directory must exist.
+ *
+ * @param dir  The store directory, null or empty disables the store.
+ */
+void ethash_set_epoch_store_dir(const char* dir) NOEXCEPT;
+
+/**
+ * Sets whether the stored full datasets are checked against their checksum when mapped.
+ *
+ * The files are complete once in the store, the check only catches later corruption
+ * and reads the whole dataset. Disabled by default, the light caches are always checked.
+ */
+void ethash_set_epoch_store_verify(bool verify) NOEXCEPT;
+
+
+/**
+ * The kind of memory pages backing the light cache and the full dataset of an epoch context.
+ *
+ * The contexts are allocated on 1 GB huge pages when available, then on 2 MB huge pages,
+ * then on normal pages advised for transparent huge pages.
+ */
+enum ethash_page_mode
+{
+    ETHASH_PAGES_NORMAL = 0,      /**< Normal pages. */
+    ETHASH_PAGES_TRANSPARENT = 1, /**< Normal pages promoted to transparent huge pages. */
+    ETHASH_PAGES_HUGE_2MB = 2,    /**< Reserved 2 MB huge pages. */
+    ETHASH_PAGES_HUGE_1GB = 3,    /**< Reserved 1 GB huge pages. */
+    ETHASH_PAGES_MAPPED = 4,      /**< Read-only mapping of the on-disk epoch store. */
+};
+
+/**
+ * Returns the kind of memory pages backing the epoch context.
+ */
+enum ethash_page_mode ethash_get_epoch_context_page_mode(
+    const struct ethash_epoch_context* context) NOEXCEPT;
+
+/**
+ * Returns a short human readable name of the page mode, e.g. "huge 1GB".
+ */
+const char* ethash_page_mode_name(enum ethash_page_mode mode) NOEXCEPT;
+
 
 struct ethash_result ethash_hash(const struct ethash_epoch_context* context,
     const union ethash_hash256* header_hash, uint64_t nonce) NOEXCEPT;
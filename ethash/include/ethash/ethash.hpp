@@ -38,6 +38,10 @@ using epoch_context_full = ethash_epoch_context_full;
 
 using result = ethash_result;
 
+using dataset_progress_fn = ethash_dataset_progress_fn;
+
+using page_mode = ethash_page_mode;
+
 /// Constructs a 256-bit hash from an array of bytes.
 ///
 /// @param bytes  A pointer to array of at least 32 bytes.
@@ -73,6 +77,14 @@ static constexpr auto calculate_full_dataset_num_items = ethash_calculate_full_d
 /// Alias for ethash_calculate_epoch_seed().
 static constexpr auto calculate_epoch_seed = ethash_calculate_epoch_seed;
 
+/// Alias for ethash_page_mode_name().
+static constexpr auto page_mode_name = ethash_page_mode_name;
+
+/// Returns the kind of memory pages backing the epoch context.
+page_mode get_page_mode(const epoch_context& context) noexcept;
+
+page_mode get_page_mode(const epoch_context_full& context) noexcept;
+
 
 /// Calculates the epoch number out of the block number.
 inline constexpr int get_epoch_number(int block_number) noexcept {
@@ -127,6 +139,25 @@ inline epoch_context_full_ptr create_epoch_context_full(int epoch_number) noexce
     return {ethash_create_epoch_context_full(epoch_number), ethash_destroy_epoch_context_full};
 }
 
+/// Creates Ethash epoch context with the full dataset generated in parallel.
+///
+/// See ethash_generate_epoch_context_full().
+inline epoch_context_full_ptr generate_epoch_context_full(int epoch_number, unsigned num_threads,
+    dataset_progress_fn progress = nullptr, void* user_data = nullptr) noexcept
+{
+    return {ethash_generate_epoch_context_full(epoch_number, num_threads, progress, user_data),
+        ethash_destroy_epoch_context_full};
+}
+
+/// Copies the epoch context with the full dataset onto the given NUMA node.
+///
+/// See ethash_copy_epoch_context_full().
+inline epoch_context_full_ptr copy_epoch_context_full(
+    const epoch_context_full& context, int numa_node) noexcept
+{
+    return {ethash_copy_epoch_context_full(&context, numa_node), ethash_destroy_epoch_context_full};
+}
+
 
 inline result hash(
     const epoch_context& context, const hash256& header_hash, uint64_t nonce) noexcept
@@ -154,6 +185,19 @@ search_result search_light(const epoch_context& context, const hash256& header_h
 search_result search(const epoch_context_full& context, const hash256& header_hash,
     const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept;
 
+/// Returns the default batch size of search_batched() for the running CPU.
+int get_search_batch_size() noexcept;
+
+/// Searches like search() but hashes @p batch_size nonces side by side.
+///
+/// The dataset accesses of all the nonces of a batch are issued together with
+/// software prefetches, so that the random DRAM reads overlap. The batch size is
+/// rounded down to a multiple of 4 in range [4, 16], 0 selects
+/// get_search_batch_size(). The first solution in nonce order is returned.
+search_result search_batched(const epoch_context_full& context, const hash256& header_hash,
+    const hash256& boundary, uint64_t start_nonce, size_t iterations,
+    int batch_size = 0) noexcept;
+
 
 /// Tries to find the epoch number matching the given seed hash.
 ///
@@ -161,6 +205,9 @@ search_result search(const epoch_context_full& context, const hash256& header_ha
 /// seed hash instead of epoch number to workers. This function tries to recover
 /// the epoch number from this seed hash.
 ///
+/// The seeds of the first 30000 epochs are indexed on first use, so the lookup
+/// takes constant time whatever the epoch.
+///
 /// @param seed  Ethash seed hash.
 /// @return      The epoch number or -1 if not found.
 int find_epoch_number(const hash256& seed) noexcept;
@@ -177,4 +224,27 @@ inline const epoch_context_full& get_global_epoch_context_full(int epoch_number)
 {
     return *ethash_get_global_epoch_context_full(epoch_number);
 }
+
+/// Get global shared epoch context, kept alive as long as the returned pointer.
+///
+/// All callers of an epoch share one context. Its light cache is read-only, so
+/// it can be read by concurrent device uploads without being copied.
+std::shared_ptr<const epoch_context> get_global_epoch_context_shared(int epoch_number) noexcept;
+
+/// Get global shared epoch context with full dataset, kept alive as long as the returned pointer.
+///
+/// The context is the one of ethash_get_global_epoch_context_full(): mapped from
+/// the store when there, otherwise created with its items generated on demand.
+/// The items can be generated ahead with ethash_generate_full_dataset_items().
+std::shared_ptr<const epoch_context_full> get_global_epoch_context_full_shared(
+    int epoch_number) noexcept;
+
+/// Alias for ethash_try_get_global_epoch_context(), null if not built yet.
+static constexpr auto try_get_global_epoch_context = ethash_try_get_global_epoch_context;
+
+/// Alias for ethash_try_get_global_epoch_context_full(), null if not built yet.
+static constexpr auto try_get_global_epoch_context_full = ethash_try_get_global_epoch_context_full;
+
+/// Alias for ethash_prebuild_global_epoch_context().
+static constexpr auto prebuild_global_epoch_context = ethash_prebuild_global_epoch_context;
 }  // namespace ethash
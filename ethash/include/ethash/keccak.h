@@ -34,6 +34,25 @@ union ethash_hash256 ethash_keccak256_32(const uint8_t data[32]) NOEXCEPT;
 union ethash_hash512 ethash_keccak512(const uint8_t* data, size_t size) NOEXCEPT;
 union ethash_hash512 ethash_keccak512_64(const uint8_t data[64]) NOEXCEPT;
 
+/**
+ * Keccak hashes of several messages of the same size computed side by side.
+ *
+ * The messages are processed in the lanes of SIMD registers when the CPU
+ * supports it (SSE2, AVX2 or AVX-512), the implementation is selected at runtime.
+ *
+ * @param out   The array receiving the hashes, one per message.
+ * @param data  The array of pointers to the messages.
+ * @param size  The size in bytes of every message.
+ */
+void ethash_keccak256_x4(
+    union ethash_hash256 out[4], const uint8_t* const data[4], size_t size) NOEXCEPT;
+void ethash_keccak512_x4(
+    union ethash_hash512 out[4], const uint8_t* const data[4], size_t size) NOEXCEPT;
+void ethash_keccak256_x8(
+    union ethash_hash256 out[8], const uint8_t* const data[8], size_t size) NOEXCEPT;
+void ethash_keccak512_x8(
+    union ethash_hash512 out[8], const uint8_t* const data[8], size_t size) NOEXCEPT;
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,32 @@ inline hash512 keccak512(const hash512& input) noexcept
     return ethash_keccak512_64(input.bytes);
 }
 
+inline void keccak256_x4(hash256 out[4], const uint8_t* const data[4], size_t size) noexcept
+{
+    ethash_keccak256_x4(out, data, size);
+}
+
+inline void keccak512_x4(hash512 out[4], const uint8_t* const data[4], size_t size) noexcept
+{
+    ethash_keccak512_x4(out, data, size);
+}
+
+inline void keccak512_x4(hash512 out[4], const hash512 input[4]) noexcept
+{
+    const uint8_t* const data[4] = {input[0].bytes, input[1].bytes, input[2].bytes, input[3].bytes};
+    ethash_keccak512_x4(out, data, sizeof(input[0]));
+}
+
+inline void keccak256_x8(hash256 out[8], const uint8_t* const data[8], size_t size) noexcept
+{
+    ethash_keccak256_x8(out, data, size);
+}
+
+inline void keccak512_x8(hash512 out[8], const uint8_t* const data[8], size_t size) noexcept
+{
+    ethash_keccak512_x8(out, data, size);
+}
+
 static constexpr auto keccak256_32 = ethash_keccak256_32;
 static constexpr auto keccak512_64 = ethash_keccak512_64;
 
@@ -36,6 +36,14 @@ inline int __builtin_popcount(unsigned int x)
     return (int)__popcnt(x);
 }
 
+/**
+ * Prefetches the cache line containing `addr` into all cache levels.
+ */
+inline void __builtin_prefetch(const void* addr)
+{
+    _mm_prefetch((const char*)addr, _MM_HINT_T0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,257 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include "epoch_memory.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// From <numaif.h>, libnuma is not required.
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#endif
+
+namespace ethash
+{
+namespace
+{
+std::atomic<bool> numa_interleave{false};
+}  // namespace
+
+void set_numa_interleave(bool interleave) noexcept
+{
+    numa_interleave.store(interleave, std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+namespace
+{
+constexpr size_t huge_page_2mb = size_t{1} << 21;
+constexpr size_t huge_page_1gb = size_t{1} << 30;
+
+inline size_t round_up(size_t size, size_t page_size) noexcept
+{
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/// Returns the size of the mapping made for the allocation of the given size.
+size_t mapping_size(size_t size, ethash_page_mode mode) noexcept
+{
+    switch (mode)
+    {
+    case ETHASH_PAGES_HUGE_1GB:
+        return round_up(size, huge_page_1gb);
+    case ETHASH_PAGES_HUGE_2MB:
+        return round_up(size, huge_page_2mb);
+    default:
+        return size;
+    }
+}
+
+void* map_anonymous(size_t size, int flags) noexcept
+{
+    void* const ptr =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return ptr != MAP_FAILED ? ptr : nullptr;
+}
+
+constexpr int node_mask_word_bits = 8 * sizeof(unsigned long);
+constexpr long max_numa_node = 4095;
+
+/// Adds the node to the node mask, as taken by mbind().
+void add_numa_node(std::vector<unsigned long>& node_mask, long node)
+{
+    const size_t word = static_cast<size_t>(node) / node_mask_word_bits;
+    if (word >= node_mask.size())
+        node_mask.resize(word + 1);
+    node_mask[word] |= 1ul << (node % node_mask_word_bits);
+}
+
+/// Reads the nodes of a sysfs node list, such as "0-1,3", into the node mask.
+/// Returns false if the list can't be read or is empty.
+bool read_numa_nodes(const char* path, std::vector<unsigned long>& node_mask)
+{
+    FILE* const f = std::fopen(path, "r");
+    if (!f)
+        return false;
+
+    char buf[4096] = {};
+    const bool ok = std::fgets(buf, sizeof(buf), f) != nullptr;
+    std::fclose(f);
+    if (!ok)
+        return false;
+
+    for (char* p = buf; *p && *p != '\n';)
+    {
+        char* end = nullptr;
+        const long first = std::strtol(p, &end, 10);
+        long last = first;
+        if (end != p && *end == '-')
+        {
+            p = end + 1;
+            last = std::strtol(p, &end, 10);
+        }
+        if (end == p || first < 0 || last < first || last > max_numa_node)
+            return false;
+        for (long node = first; node <= last; ++node)
+            add_numa_node(node_mask, node);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !node_mask.empty();
+}
+
+/// Sets the NUMA policy of the not yet touched mapping. The preferred node
+/// falls back to the other nodes when full, interleaving spreads the pages
+/// over the nodes with memory. Failures leave the default placement.
+void place_on_numa_nodes(void* ptr, size_t size, int numa_node) noexcept
+{
+#if defined(SYS_mbind)
+    std::vector<unsigned long> node_mask;
+    int policy;
+    try
+    {
+        if (numa_node >= 0 && numa_node <= max_numa_node)
+        {
+            add_numa_node(node_mask, numa_node);
+            policy = MPOL_PREFERRED;
+        }
+        else if (numa_node < 0 && numa_interleave.load(std::memory_order_relaxed) &&
+                 read_numa_nodes("/sys/devices/system/node/has_memory", node_mask))
+            policy = MPOL_INTERLEAVE;
+        else
+            return;
+    }
+    catch (...)
+    {
+        return;
+    }
+
+    // The kernel reads one bit less than maxnode
+    const unsigned long max_node = node_mask.size() * node_mask_word_bits + 1;
+    syscall(SYS_mbind, ptr, size, policy, node_mask.data(), max_node, 0);
+#else
+    (void)ptr;
+    (void)size;
+    (void)numa_node;
+#endif
+}
+
+/// Checks if the kernel honors MADV_HUGEPAGE, i.e. transparent huge pages are not disabled.
+bool transparent_huge_pages_enabled() noexcept
+{
+    FILE* const f = std::fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (!f)
+        return false;
+
+    char buf[128] = {};
+    const bool ok = std::fgets(buf, sizeof(buf), f) != nullptr;
+    std::fclose(f);
+    return ok && std::strstr(buf, "[never]") == nullptr;
+}
+}  // namespace
+
+void* allocate_epoch_memory(size_t size, ethash_page_mode& mode, int numa_node) noexcept
+{
+    // Reserved huge pages are only worth it when at least one is filled.
+    // The pages come zeroed from the kernel.
+    if (size >= huge_page_1gb)
+    {
+        if (void* const ptr = map_anonymous(
+                mapping_size(size, ETHASH_PAGES_HUGE_1GB), MAP_HUGETLB | MAP_HUGE_1GB))
+        {
+            place_on_numa_nodes(ptr, mapping_size(size, ETHASH_PAGES_HUGE_1GB), numa_node);
+            mode = ETHASH_PAGES_HUGE_1GB;
+            return ptr;
+        }
+    }
+
+    if (size >= huge_page_2mb)
+    {
+        if (void* const ptr = map_anonymous(
+                mapping_size(size, ETHASH_PAGES_HUGE_2MB), MAP_HUGETLB | MAP_HUGE_2MB))
+        {
+            place_on_numa_nodes(ptr, mapping_size(size, ETHASH_PAGES_HUGE_2MB), numa_node);
+            mode = ETHASH_PAGES_HUGE_2MB;
+            return ptr;
+        }
+    }
+
+    void* const ptr = map_anonymous(size, 0);
+    if (!ptr)
+        return nullptr;
+
+    place_on_numa_nodes(ptr, size, numa_node);
+    mode = ETHASH_PAGES_NORMAL;
+#if defined(MADV_HUGEPAGE)
+    if (size >= huge_page_2mb && madvise(ptr, size, MADV_HUGEPAGE) == 0 &&
+        transparent_huge_pages_enabled())
+        mode = ETHASH_PAGES_TRANSPARENT;
+#endif
+    return ptr;
+}
+
+void free_epoch_memory(void* ptr, size_t size, ethash_page_mode mode) noexcept
+{
+    if (ptr)
+        munmap(ptr, mapping_size(size, mode));
+}
+
+#else
+
+void* allocate_epoch_memory(size_t size, ethash_page_mode& mode, int) noexcept
+{
+    mode = ETHASH_PAGES_NORMAL;
+    return std::calloc(1, size);
+}
+
+void free_epoch_memory(void* ptr, size_t, ethash_page_mode) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
+}  // namespace ethash
+
+extern "C" {
+
+const char* ethash_page_mode_name(ethash_page_mode mode) noexcept
+{
+    switch (mode)
+    {
+    case ETHASH_PAGES_TRANSPARENT:
+        return "transparent huge";
+    case ETHASH_PAGES_HUGE_2MB:
+        return "huge 2MB";
+    case ETHASH_PAGES_HUGE_1GB:
+        return "huge 1GB";
+    case ETHASH_PAGES_MAPPED:
+        return "mapped";
+    default:
+        return "normal";
+    }
+}
+
+}  // extern "C"
@@ -0,0 +1,39 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The memory of epoch contexts.
+///
+/// The full dataset is read at random, so with normal pages nearly every
+/// access misses the TLB. The contexts are therefore placed on the largest
+/// huge pages the system provides.
+
+#pragma once
+
+#include <ethash/ethash.h>
+
+#include <cstddef>
+
+namespace ethash
+{
+/// Allocates zeroed memory for an epoch context.
+///
+/// Tries reserved 1 GB huge pages, then reserved 2 MB huge pages, then normal
+/// pages advised for transparent huge pages.
+///
+/// The pages are placed on the preferred NUMA node when one is given, otherwise
+/// they are interleaved across the nodes if set_numa_interleave() was enabled.
+///
+/// @param size       The size of the allocation.
+/// @param[out] mode  The kind of pages backing the memory.
+/// @param numa_node  The preferred NUMA node or -1 for the default placement.
+/// @return  The memory or null if out of memory.
+void* allocate_epoch_memory(size_t size, ethash_page_mode& mode, int numa_node = -1) noexcept;
+
+/// Sets whether the memory without a preferred NUMA node is interleaved across the nodes.
+void set_numa_interleave(bool interleave) noexcept;
+
+/// Frees the memory returned by allocate_epoch_memory().
+void free_epoch_memory(void* ptr, size_t size, ethash_page_mode mode) noexcept;
+}  // namespace ethash
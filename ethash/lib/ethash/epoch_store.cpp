@@ -0,0 +1,357 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+#include "epoch_store.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ethash
+{
+namespace store
+{
+#if !defined(_WIN32)
+namespace
+{
+constexpr char magic[8] = {'E', 'T', 'H', 'A', 'S', 'H', 'S', 'T'};
+constexpr uint32_t format_version = 1;
+
+/// The header of a stored file. The items start at the next page.
+struct file_header
+{
+    char magic[8];
+    uint32_t version;
+    int32_t epoch_number;
+    uint64_t num_items;
+    uint64_t item_size;
+    uint64_t checksum;
+};
+
+constexpr size_t header_size = 4096;
+
+/// Seconds after which a temporary file is taken as left by a crashed writer.
+/// A live writer keeps the modification time of its file recent.
+constexpr time_t stale_tmp_seconds = 3600;
+
+/// The epochs kept in the store, the most recently used ones. Enough for the
+/// current and next epochs of two chains mined in turns.
+constexpr size_t max_stored_epochs = 4;
+static_assert(sizeof(file_header) <= header_size, "");
+
+/// 64-bit FNV-1a over words, in four interleaved streams to run at memory speed.
+uint64_t checksum(const uint8_t* data, size_t size) noexcept
+{
+    static constexpr uint64_t offset_basis = 0xcbf29ce484222325;
+    static constexpr uint64_t prime = 0x100000001b3;
+
+    uint64_t h[4] = {offset_basis, offset_basis + 1, offset_basis + 2, offset_basis + 3};
+    const size_t num_words = size / sizeof(uint64_t);
+    for (size_t i = 0; i + 4 <= num_words; i += 4)
+    {
+        for (size_t k = 0; k < 4; ++k)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + (i + k) * sizeof(word), sizeof(word));
+            h[k] = (h[k] ^ word) * prime;
+        }
+    }
+
+    uint64_t r = offset_basis;
+    for (size_t k = 0; k < 4; ++k)
+        r = (r ^ h[k]) * prime;
+    return r;
+}
+
+std::string file_path(const std::string& dir, int epoch_number, const char* extension)
+{
+    return dir + "/epoch-" + std::to_string(epoch_number) + extension;
+}
+
+/// A read-only shared mapping of a stored file.
+struct mapped_file
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    mapped_file() noexcept = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file()
+    {
+        if (data)
+            munmap(const_cast<uint8_t*>(data), size);
+    }
+
+    const uint8_t* items() const noexcept { return data + header_size; }
+};
+
+/// Maps the file and validates its header, and its checksum if asked to. The
+/// file was complete when renamed into place, the checksum only catches later
+/// corruption and reads all the items.
+std::shared_ptr<mapped_file> map_file(
+    const std::string& path, int epoch_number, int num_items, size_t item_size, bool verify) noexcept
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    const size_t expected_size = header_size + static_cast<size_t>(num_items) * item_size;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != expected_size)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // Marks the file used, prune() keeps the recently used epochs. Files of
+    // other users may refuse, they are just pruned earlier.
+    futimens(fd, nullptr);
+
+    void* const data = mmap(nullptr, expected_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<mapped_file> file;
+    try
+    {
+        file = std::make_shared<mapped_file>();
+    }
+    catch (...)
+    {
+        munmap(data, expected_size);
+        return nullptr;
+    }
+    file->data = static_cast<const uint8_t*>(data);
+    file->size = expected_size;
+
+    // The items are about to be read in whole anyway.
+    madvise(data, expected_size, MADV_WILLNEED);
+
+    file_header header;
+    std::memcpy(&header, file->data, sizeof(header));
+    const size_t items_size = expected_size - header_size;
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != format_version ||
+        header.epoch_number != epoch_number || header.num_items != uint64_t(num_items) ||
+        header.item_size != item_size ||
+        (verify && header.checksum != checksum(file->items(), items_size)))
+        return nullptr;
+
+    return file;
+}
+
+/// Writes the file under a temporary name and renames it into place, so that
+/// readers never see a partial file.
+bool write_file(const std::string& path, int epoch_number, const void* items, int num_items,
+    size_t item_size) noexcept
+{
+    const size_t items_size = static_cast<size_t>(num_items) * item_size;
+
+    file_header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = format_version;
+    header.epoch_number = epoch_number;
+    header.num_items = static_cast<uint64_t>(num_items);
+    header.item_size = item_size;
+    header.checksum = checksum(static_cast<const uint8_t*>(items), items_size);
+
+    uint8_t page[header_size] = {};
+    std::memcpy(page, &header, sizeof(header));
+
+    // Unique per writer, threads and processes may store the same epoch at once.
+    std::string tmp_path = path + ".tmp.XXXXXX";
+    const int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0)
+        return false;
+    fchmod(fd, 0644);  // Mapped by the other processes sharing the store.
+    FILE* const f = fdopen(fd, "wb");
+    if (!f)
+    {
+        close(fd);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    bool ok = std::fwrite(page, 1, sizeof(page), f) == sizeof(page) &&
+              std::fwrite(items, 1, items_size, f) == items_size;
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Removes the stored files of all but the max_stored_epochs most recently
+/// written or mapped epochs, and the stale temporary files. The epoch being
+/// stored is always kept.
+void prune(const std::string& dir, int epoch_number) noexcept
+{
+    DIR* const d = opendir(dir.c_str());
+    if (!d)
+        return;
+
+    try
+    {
+        std::map<int, std::vector<std::string>> files;
+        std::map<int, time_t> last_used;
+        const time_t now = time(nullptr);
+        while (const dirent* entry = readdir(d))
+        {
+            if (std::strncmp(entry->d_name, "epoch-", 6) == 0 && std::strstr(entry->d_name, ".tmp."))
+            {
+                const std::string path = dir + "/" + entry->d_name;
+                struct stat st;
+                if (stat(path.c_str(), &st) == 0 && now - st.st_mtime > stale_tmp_seconds)
+                    std::remove(path.c_str());
+                continue;
+            }
+
+            int stored_epoch = 0;
+            char extension[8] = {};
+            if (std::sscanf(entry->d_name, "epoch-%d.%7s", &stored_epoch, extension) != 2)
+                continue;
+            if (std::strcmp(extension, "light") != 0 && std::strcmp(extension, "dag") != 0)
+                continue;
+            const std::string path = dir + "/" + entry->d_name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                continue;
+            files[stored_epoch].push_back(path);
+            last_used[stored_epoch] = std::max(last_used[stored_epoch], st.st_mtime);
+        }
+
+        std::vector<std::pair<time_t, int>> epochs;
+        for (const auto& e : last_used)
+        {
+            if (e.first != epoch_number)
+                epochs.emplace_back(e.second, e.first);
+        }
+        std::sort(epochs.rbegin(), epochs.rend());
+        for (size_t i = max_stored_epochs - 1; i < epochs.size(); ++i)
+        {
+            for (const auto& path : files[epochs[i].second])
+                std::remove(path.c_str());
+        }
+    }
+    catch (...)
+    {
+        // Nothing removed this time.
+    }
+    closedir(d);
+}
+}  // namespace
+
+std::shared_ptr<epoch_context> load_epoch_context(const std::string& dir, int epoch_number) noexcept
+{
+    const auto light = map_file(file_path(dir, epoch_number, ".light"), epoch_number,
+        get_epoch_light_cache_num_items(epoch_number), sizeof(hash512), true);
+    if (!light)
+        return nullptr;
+
+    epoch_context* const context = create_epoch_context_external(
+        epoch_number, reinterpret_cast<const hash512*>(light->items()), nullptr);
+    if (!context)
+        return nullptr;
+
+    try
+    {
+        // The mapping is released after the context.
+        return std::shared_ptr<epoch_context>{context, [light](epoch_context* c) noexcept {
+                                                  ethash_destroy_epoch_context(c);
+                                              }};
+    }
+    catch (...)
+    {
+        return nullptr;  // The deleter has already destroyed the context.
+    }
+}
+
+std::shared_ptr<epoch_context_full> load_epoch_context_full(
+    const std::string& dir, int epoch_number, bool verify) noexcept
+{
+    const auto light = map_file(file_path(dir, epoch_number, ".light"), epoch_number,
+        get_epoch_light_cache_num_items(epoch_number), sizeof(hash512), true);
+    if (!light)
+        return nullptr;
+
+    const auto dag = map_file(file_path(dir, epoch_number, ".dag"), epoch_number,
+        get_epoch_full_dataset_num_items(epoch_number), sizeof(hash1024), verify);
+    if (!dag)
+        return nullptr;
+
+    epoch_context_full* const context =
+        create_epoch_context_external(epoch_number, reinterpret_cast<const hash512*>(light->items()),
+            reinterpret_cast<const hash1024*>(dag->items()));
+    if (!context)
+        return nullptr;
+
+    try
+    {
+        return std::shared_ptr<epoch_context_full>{
+            context, [light, dag](epoch_context_full* c) noexcept {
+                ethash_destroy_epoch_context_full(c);
+            }};
+    }
+    catch (...)
+    {
+        return nullptr;  // The deleter has already destroyed the context.
+    }
+}
+
+void save_epoch_context(const std::string& dir, const epoch_context& context) noexcept
+{
+    prune(dir, context.epoch_number);
+    write_file(file_path(dir, context.epoch_number, ".light"), context.epoch_number,
+        context.light_cache, context.light_cache_num_items, sizeof(hash512));
+}
+
+void save_epoch_context_full(const std::string& dir, const epoch_context_full& context) noexcept
+{
+    // The light cache is usually stored already, by the light context of the epoch.
+    if (!map_file(file_path(dir, context.epoch_number, ".light"), context.epoch_number,
+            context.light_cache_num_items, sizeof(hash512), true))
+        save_epoch_context(dir, context);
+    else
+        prune(dir, context.epoch_number);
+
+    write_file(file_path(dir, context.epoch_number, ".dag"), context.epoch_number,
+        context.full_dataset, context.full_dataset_num_items, sizeof(hash1024));
+}
+
+#else
+
+// No memory mapped store on Windows, the contexts are always built.
+
+std::shared_ptr<epoch_context> load_epoch_context(const std::string&, int) noexcept
+{
+    return nullptr;
+}
+
+std::shared_ptr<epoch_context_full> load_epoch_context_full(const std::string&, int, bool) noexcept
+{
+    return nullptr;
+}
+
+void save_epoch_context(const std::string&, const epoch_context&) noexcept {}
+
+void save_epoch_context_full(const std::string&, const epoch_context_full&) noexcept {}
+
+#endif
+}  // namespace store
+}  // namespace ethash
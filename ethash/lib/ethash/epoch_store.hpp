@@ -0,0 +1,47 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018-2019 Pawel Bylica.
+// Licensed under the Apache License, Version 2.0.
+
+/// @file
+/// The on-disk store of light caches and full datasets.
+///
+/// Every epoch is kept in the store directory as epoch-<n>.light and
+/// epoch-<n>.dag files. A file has a header page with its checksum followed by
+/// the raw items. Files are written once and later mapped read-only, so several
+/// processes on the same host share the memory through the page cache.
+
+#pragma once
+
+#include "ethash-internal.hpp"
+
+#include <memory>
+#include <string>
+
+namespace ethash
+{
+namespace store
+{
+/// Maps the stored light cache of the epoch.
+///
+/// @return  The context or null if the file is missing or invalid.
+std::shared_ptr<epoch_context> load_epoch_context(const std::string& dir, int epoch_number) noexcept;
+
+/// Maps the stored light cache and full dataset of the epoch.
+///
+/// The light cache checksum is always verified, the dataset one only if @p verify
+/// is set: it reads the whole dataset.
+///
+/// @return  The context or null if any of the files is missing or invalid.
+std::shared_ptr<epoch_context_full> load_epoch_context_full(
+    const std::string& dir, int epoch_number, bool verify) noexcept;
+
+/// Stores the light cache of the context, replacing the stored file if any.
+///
+/// Only the files of the few most recently stored or mapped epochs are kept.
+void save_epoch_context(const std::string& dir, const epoch_context& context) noexcept;
+
+/// Stores the completely generated full dataset of the context, and its light
+/// cache unless that one is stored already.
+void save_epoch_context_full(const std::string& dir, const epoch_context_full& context) noexcept;
+}  // namespace store
+}  // namespace ethash
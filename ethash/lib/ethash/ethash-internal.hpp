@@ -12,6 +12,7 @@
 
 #include "endianness.hpp"
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -19,10 +20,26 @@ extern "C" struct ethash_epoch_context_full : ethash_epoch_context
 {
     ethash_hash1024* full_dataset;
 
+    /// Bitmaps of the full dataset items, one bit per item.
+    ///
+    /// An item is written only by the thread which set its claimed bit first and
+    /// may be read from full_dataset only after its ready bit is set.
+    std::atomic<uint32_t>* full_dataset_claimed;
+    std::atomic<uint32_t>* full_dataset_ready;
+
+    /// The size and pages of the context allocation, see allocate_epoch_memory().
+    size_t alloc_size = 0;
+    ethash_page_mode alloc_mode = ETHASH_PAGES_NORMAL;
+
+    /// The pages backing the light cache and the full dataset.
+    ethash_page_mode page_mode = ETHASH_PAGES_NORMAL;
+
     constexpr ethash_epoch_context_full(int epoch, int light_num_items, const ethash_hash512* light,
                                         const uint32_t* l1,
-                                        int dataset_num_items, ethash_hash1024* dataset) noexcept
-        : ethash_epoch_context{epoch, light_num_items, light, l1, dataset_num_items}, full_dataset{dataset} {}
+                                        int dataset_num_items, ethash_hash1024* dataset,
+                                        std::atomic<uint32_t>* claimed, std::atomic<uint32_t>* ready) noexcept
+        : ethash_epoch_context{epoch, light_num_items, light, l1, dataset_num_items}, full_dataset{dataset},
+          full_dataset_claimed{claimed}, full_dataset_ready{ready} {}
 };
 
 namespace ethash
@@ -46,10 +63,35 @@ inline bool is_equal(const hash256& a, const hash256& b) noexcept
 
 void build_light_cache(hash512 cache[], int num_items, const hash256& seed) noexcept;
 
+/// The number of light cache / full dataset items of the epoch, ECIP-1099 applied.
+int get_epoch_light_cache_num_items(int epoch_number) noexcept;
+int get_epoch_full_dataset_num_items(int epoch_number) noexcept;
+
+/// Creates the epoch context around a light cache and an optional complete full
+/// dataset owned by the caller. The memory must outlive the context.
+epoch_context_full* create_epoch_context_external(
+    int epoch_number, const hash512* light_cache, const hash1024* full_dataset) noexcept;
+
+/// Copies the light cache and the generated part of the full dataset of the
+/// context into a new allocation placed on the preferred NUMA node.
+epoch_context_full* create_epoch_context_copy(const epoch_context_full& context, int numa_node) noexcept;
+
 hash512 calculate_dataset_item_512(const epoch_context& context, int64_t index) noexcept;
 hash1024 calculate_dataset_item_1024(const epoch_context& context, uint32_t index) noexcept;
 hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t index) noexcept;
 
+/// Fills the whole full dataset of the context using @p num_threads threads.
+///
+/// @return  false if the generation was cancelled by the progress callback.
+bool generate_full_dataset(epoch_context_full& context, unsigned num_threads,
+    dataset_progress_fn progress, void* user_data) noexcept;
+
+/// Generates the items [begin, end) not generated yet, see ethash_generate_full_dataset_items().
+void generate_full_dataset_items(const epoch_context_full& context, int begin, int end) noexcept;
+
+/// Checks if every item of the full dataset has been generated.
+bool is_full_dataset_generated(const epoch_context_full& context) noexcept;
+
 namespace generic
 {
 using hash_fn_512 = hash512 (*)(const uint8_t* data, size_t size);
@@ -7,13 +7,18 @@
 #include "../support/attributes.h"
 #include "bit_manipulation.h"
 #include "endianness.hpp"
+#include "epoch_memory.hpp"
 #include "primes.h"
 #include <ethash/keccak.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <thread>
+#include <vector>
 
 namespace ethash
 {
@@ -24,6 +29,8 @@ constexpr static int light_cache_rounds = 3;
 constexpr static int full_dataset_init_size = 1 << 30;
 constexpr static int full_dataset_growth = 1 << 23;
 constexpr static int full_dataset_item_parents = 256;
+constexpr static int full_dataset_chunk_items = 1 << 13;  // Items per generation work unit.
+constexpr static int max_search_batch_size = 16;
 // ECIP-1099
 constexpr static int ecip_1099_activation_epoch = 390; // classic mainnet
 // constexpr static int ecip_1099_activation_epoch = 84; // mordor
@@ -55,46 +62,88 @@ inline hash512 bitwise_xor(const hash512& x, const hash512& y) noexcept
 }
 }  // namespace
 
-int find_epoch_number(const hash256& seed) noexcept
+namespace
 {
-    static constexpr int num_tries = 30000;  // Divisible by 16.
-
-    // Thread-local cache of the last search.
-    static thread_local int cached_epoch_number = 0;
-    static thread_local hash256 cached_seed = {};
-
-    // Load from memory once (memory will be clobbered by keccak256()).
-    const uint32_t seed_part = seed.word32s[0];
-    const int e = cached_epoch_number;
-    hash256 s = cached_seed;
+/// The number of epochs covered by the seed index and the item count tables.
+constexpr int num_indexed_epochs = 30000;
 
-    if (s.word32s[0] == seed_part)
-        return e;
+/// The seeds of all indexed epochs with a hash table from a seed to its epoch.
+///
+/// Built once on first use, it takes ~10 ms. The table is open addressed by
+/// the low bits of the seeds, which are uniformly distributed keccak hashes.
+class epoch_seed_index
+{
+public:
+    epoch_seed_index() noexcept
+    {
+        hash256 s = {};
+        for (int i = 0; i < num_indexed_epochs; ++i)
+        {
+            seeds_[static_cast<size_t>(i)] = s;
+            size_t slot = s.word64s[0] & slot_mask;
+            while (slots_[slot] != 0)
+                slot = (slot + 1) & slot_mask;
+            slots_[slot] = static_cast<uint16_t>(i + 1);
+            s = keccak256(s);
+        }
+    }
 
-    // Try the next seed, will match for sequential epoch access.
-    s = keccak256(s);
-    if (s.word32s[0] == seed_part)
+    const hash256& seed(int epoch_number) const noexcept
     {
-        cached_seed = s;
-        cached_epoch_number = e + 1;
-        return e + 1;
+        return seeds_[static_cast<size_t>(epoch_number)];
     }
 
-    // Search for matching seed starting from epoch 0.
-    s = {};
-    for (int i = 0; i < num_tries; ++i)
+    int find(const hash256& seed) const noexcept
     {
-        if (s.word32s[0] == seed_part)
+        for (size_t slot = seed.word64s[0] & slot_mask; slots_[slot] != 0;
+             slot = (slot + 1) & slot_mask)
         {
-            cached_seed = s;
-            cached_epoch_number = i;
-            return i;
+            const int epoch_number = slots_[slot] - 1;
+            if (is_equal(seeds_[static_cast<size_t>(epoch_number)], seed))
+                return epoch_number;
         }
+        return -1;
+    }
+
+private:
+    static constexpr size_t num_slots = 1 << 16;  // Load factor below 1/2.
+    static constexpr size_t slot_mask = num_slots - 1;
+    static_assert(num_indexed_epochs < num_slots, "epoch index too small");
+
+    std::vector<hash256> seeds_ = std::vector<hash256>(num_indexed_epochs);
+    std::vector<uint16_t> slots_ = std::vector<uint16_t>(num_slots);  ///< Epoch + 1, 0 if empty.
+};
+
+const epoch_seed_index& get_epoch_seed_index() noexcept
+{
+    static const epoch_seed_index index;
+    return index;
+}
+
+/// The item counts of the indexed epochs, each computed once on first use.
+std::atomic<int> light_cache_num_items_table[num_indexed_epochs];
+std::atomic<int> full_dataset_num_items_table[num_indexed_epochs];
+
+template <typename CalculateFn>
+int get_memoized_num_items(std::atomic<int>* table, int epoch_number, CalculateFn calculate) noexcept
+{
+    if (epoch_number < 0 || epoch_number >= num_indexed_epochs)
+        return calculate(epoch_number);
 
-        s = keccak256(s);
+    // Racing threads compute the same value, no need to synchronize them.
+    int num_items = table[epoch_number].load(std::memory_order_relaxed);
+    if (num_items == 0)
+    {
+        num_items = calculate(epoch_number);
+        table[epoch_number].store(num_items, std::memory_order_relaxed);
     }
+    return num_items;
+}
+}  // namespace
 
-    return -1;
+int find_epoch_number(const hash256& seed) noexcept
+{
+    return get_epoch_seed_index().find(seed);
 }
 
 namespace generic
@@ -129,27 +178,108 @@ void build_light_cache(
     }
 }
 
-epoch_context_full* create_epoch_context(
-    build_light_cache_fn build_fn, int epoch_number, bool full) noexcept
-{
-    static_assert(sizeof(epoch_context_full) < sizeof(hash512), "epoch_context too big");
-    static constexpr size_t context_alloc_size = sizeof(hash512);
+}  // namespace generic
 
+namespace
+{
+/// The epoch number the cache and dataset sizes are derived from.
+inline int get_ecip1099_epoch_number(int epoch_number) noexcept
+{
     // TODO - iquidus
-    int epoch_ecip1099 = epoch_number;
     if (epoch_number >= ecip_1099_activation_epoch) {
         // note, int truncates, it doesnt round, 10 == 10.5. So this is ok.
-        epoch_ecip1099 = epoch_number / 2;
+        return epoch_number / 2;
     }
+    return epoch_number;
+}
+}  // namespace
+
+int get_epoch_light_cache_num_items(int epoch_number) noexcept
+{
+    return calculate_light_cache_num_items(get_ecip1099_epoch_number(epoch_number));
+}
+
+int get_epoch_full_dataset_num_items(int epoch_number) noexcept
+{
+    return calculate_full_dataset_num_items(get_ecip1099_epoch_number(epoch_number));
+}
+
+page_mode get_page_mode(const epoch_context& context) noexcept
+{
+    return static_cast<const epoch_context_full&>(context).page_mode;
+}
+
+page_mode get_page_mode(const epoch_context_full& context) noexcept
+{
+    return context.page_mode;
+}
+
+/// The space before the light cache taken by the context itself, keeps the light cache aligned.
+constexpr size_t context_alloc_size = 2 * sizeof(hash512);
+static_assert(sizeof(epoch_context_full) <= context_alloc_size, "epoch_context too big");
+
+epoch_context_full* create_epoch_context_external(
+    int epoch_number, const hash512* light_cache, const hash1024* full_dataset) noexcept
+{
+    const int full_dataset_num_items = get_epoch_full_dataset_num_items(epoch_number);
+    const size_t full_dataset_bitmap_words =
+        full_dataset ? (static_cast<size_t>(full_dataset_num_items) + 31) / 32 : 0;
+    const size_t full_dataset_bitmap_size = full_dataset_bitmap_words * sizeof(std::atomic<uint32_t>);
+
+    const size_t alloc_size = context_alloc_size + 2 * full_dataset_bitmap_size;
+    ethash_page_mode alloc_mode;
+    char* const alloc_data = static_cast<char*>(allocate_epoch_memory(alloc_size, alloc_mode));
+    if (!alloc_data)
+        return nullptr;
+
+    // The external dataset is complete, it is never written to.
+    std::atomic<uint32_t>* full_dataset_claimed = nullptr;
+    std::atomic<uint32_t>* full_dataset_ready = nullptr;
+    if (full_dataset)
+    {
+        char* const bitmaps = alloc_data + context_alloc_size;
+        full_dataset_claimed = reinterpret_cast<std::atomic<uint32_t>*>(bitmaps);
+        full_dataset_ready = reinterpret_cast<std::atomic<uint32_t>*>(bitmaps + full_dataset_bitmap_size);
+        for (size_t i = 0; i < full_dataset_bitmap_words; ++i)
+        {
+            new (&full_dataset_claimed[i]) std::atomic<uint32_t>{~uint32_t{0}};
+            new (&full_dataset_ready[i]) std::atomic<uint32_t>{~uint32_t{0}};
+        }
+    }
+
+    epoch_context_full* const context = new (alloc_data) epoch_context_full{
+        epoch_number,
+        get_epoch_light_cache_num_items(epoch_number),
+        light_cache,
+        reinterpret_cast<const uint32_t*>(full_dataset),
+        full_dataset_num_items,
+        const_cast<hash1024*>(full_dataset),
+        full_dataset_claimed,
+        full_dataset_ready,
+    };
+    context->alloc_size = alloc_size;
+    context->alloc_mode = alloc_mode;
+    context->page_mode = ETHASH_PAGES_MAPPED;
+    return context;
+}
 
-    const int light_cache_num_items = calculate_light_cache_num_items(epoch_ecip1099);
-    const int full_dataset_num_items = calculate_full_dataset_num_items(epoch_ecip1099);
+namespace generic
+{
+epoch_context_full* create_epoch_context(
+    build_light_cache_fn build_fn, int epoch_number, bool full) noexcept
+{
+    const int light_cache_num_items = get_epoch_light_cache_num_items(epoch_number);
+    const int full_dataset_num_items = get_epoch_full_dataset_num_items(epoch_number);
     const size_t light_cache_size = get_light_cache_size(light_cache_num_items);
     const size_t full_dataset_size = full ? static_cast<size_t>(full_dataset_num_items) * sizeof(hash1024) : 0;
+    const size_t full_dataset_bitmap_words = full ? (static_cast<size_t>(full_dataset_num_items) + 31) / 32 : 0;
+    const size_t full_dataset_bitmap_size = full_dataset_bitmap_words * sizeof(std::atomic<uint32_t>);
 
-    const size_t alloc_size = context_alloc_size + light_cache_size + full_dataset_size;
+    const size_t alloc_size =
+        context_alloc_size + light_cache_size + full_dataset_size + 2 * full_dataset_bitmap_size;
 
-    char* const alloc_data = static_cast<char*>(std::calloc(1, alloc_size));
+    ethash_page_mode alloc_mode;
+    char* const alloc_data = static_cast<char*>(allocate_epoch_memory(alloc_size, alloc_mode));
     if (!alloc_data)
         return nullptr;  // Signal out-of-memory by returning null pointer.
 
@@ -162,6 +292,20 @@ epoch_context_full* create_epoch_context(
 
     hash1024* full_dataset = full ? reinterpret_cast<hash1024*>(l1_cache) : nullptr;
 
+    std::atomic<uint32_t>* full_dataset_claimed = nullptr;
+    std::atomic<uint32_t>* full_dataset_ready = nullptr;
+    if (full)
+    {
+        char* const bitmaps = alloc_data + context_alloc_size + light_cache_size + full_dataset_size;
+        full_dataset_claimed = reinterpret_cast<std::atomic<uint32_t>*>(bitmaps);
+        full_dataset_ready = reinterpret_cast<std::atomic<uint32_t>*>(bitmaps + full_dataset_bitmap_size);
+        for (size_t i = 0; i < full_dataset_bitmap_words; ++i)
+        {
+            new (&full_dataset_claimed[i]) std::atomic<uint32_t>{0};
+            new (&full_dataset_ready[i]) std::atomic<uint32_t>{0};
+        }
+    }
+
     epoch_context_full* const context = new (alloc_data) epoch_context_full{
         epoch_number,
         light_cache_num_items,
@@ -169,12 +313,71 @@ epoch_context_full* create_epoch_context(
         l1_cache,
         full_dataset_num_items,
         full_dataset,
+        full_dataset_claimed,
+        full_dataset_ready,
     };
+    context->alloc_size = alloc_size;
+    context->alloc_mode = alloc_mode;
+    context->page_mode = alloc_mode;
 
     return context;
 }
 }  // namespace generic
 
+epoch_context_full* create_epoch_context_copy(const epoch_context_full& context, int numa_node) noexcept
+{
+    const int light_cache_num_items = context.light_cache_num_items;
+    const int full_dataset_num_items = context.full_dataset_num_items;
+    const size_t light_cache_size = get_light_cache_size(light_cache_num_items);
+    const size_t full_dataset_size = static_cast<size_t>(full_dataset_num_items) * sizeof(hash1024);
+    const size_t full_dataset_bitmap_words = (static_cast<size_t>(full_dataset_num_items) + 31) / 32;
+    const size_t full_dataset_bitmap_size = full_dataset_bitmap_words * sizeof(std::atomic<uint32_t>);
+
+    const size_t alloc_size =
+        context_alloc_size + light_cache_size + full_dataset_size + 2 * full_dataset_bitmap_size;
+
+    ethash_page_mode alloc_mode;
+    char* const alloc_data =
+        static_cast<char*>(allocate_epoch_memory(alloc_size, alloc_mode, numa_node));
+    if (!alloc_data)
+        return nullptr;
+
+    hash512* const light_cache = reinterpret_cast<hash512*>(alloc_data + context_alloc_size);
+    std::memcpy(light_cache, context.light_cache, light_cache_size);
+
+    hash1024* const full_dataset =
+        reinterpret_cast<hash1024*>(alloc_data + context_alloc_size + light_cache_size);
+
+    // Snapshot the ready bits before the items: every item marked ready here has
+    // been written completely. The other items are left to be computed again.
+    char* const bitmaps = alloc_data + context_alloc_size + light_cache_size + full_dataset_size;
+    auto* const full_dataset_claimed = reinterpret_cast<std::atomic<uint32_t>*>(bitmaps);
+    auto* const full_dataset_ready =
+        reinterpret_cast<std::atomic<uint32_t>*>(bitmaps + full_dataset_bitmap_size);
+    for (size_t i = 0; i < full_dataset_bitmap_words; ++i)
+    {
+        const uint32_t ready = context.full_dataset_ready[i].load(std::memory_order_acquire);
+        new (&full_dataset_claimed[i]) std::atomic<uint32_t>{ready};
+        new (&full_dataset_ready[i]) std::atomic<uint32_t>{ready};
+    }
+    std::memcpy(full_dataset, context.full_dataset, full_dataset_size);
+
+    epoch_context_full* const copy = new (alloc_data) epoch_context_full{
+        context.epoch_number,
+        light_cache_num_items,
+        light_cache,
+        reinterpret_cast<const uint32_t*>(full_dataset),
+        full_dataset_num_items,
+        full_dataset,
+        full_dataset_claimed,
+        full_dataset_ready,
+    };
+    copy->alloc_size = alloc_size;
+    copy->alloc_mode = alloc_mode;
+    copy->page_mode = alloc_mode;
+    return copy;
+}
+
 void build_light_cache(hash512 cache[], int num_items, const hash256& seed) noexcept
 {
     return generic::build_light_cache(keccak512, cache, num_items, seed);
@@ -189,13 +392,24 @@ struct item_state
     hash512 mix;
 
     ALWAYS_INLINE item_state(const epoch_context& context, int64_t index) noexcept
+      : item_state{context, index, keccak512(init_mix(context, index))}
+    {}
+
+    /// Constructs the state from the already hashed initial mix.
+    ALWAYS_INLINE item_state(
+        const epoch_context& context, int64_t index, const hash512& hashed_mix) noexcept
       : cache{context.light_cache},
         num_cache_items{context.light_cache_num_items},
-        seed{static_cast<uint32_t>(index)}
+        seed{static_cast<uint32_t>(index)},
+        mix{le::uint32s(hashed_mix)}
+    {}
+
+    /// The initial mix of the item, to be hashed with Keccak-512.
+    static ALWAYS_INLINE hash512 init_mix(const epoch_context& context, int64_t index) noexcept
     {
-        mix = cache[index % num_cache_items];
-        mix.word32s[0] ^= le::uint32(seed);
-        mix = le::uint32s(keccak512(mix));
+        hash512 m = context.light_cache[index % context.light_cache_num_items];
+        m.word32s[0] ^= le::uint32(static_cast<uint32_t>(index));
+        return m;
     }
 
     ALWAYS_INLINE void update(uint32_t round) noexcept
@@ -206,7 +420,10 @@ struct item_state
         mix = fnv1(mix, le::uint32s(cache[parent_index]));
     }
 
-    ALWAYS_INLINE hash512 final() noexcept { return keccak512(le::uint32s(mix)); }
+    ALWAYS_INLINE hash512 final() noexcept { return keccak512(final_mix()); }
+
+    /// The final mix of the item, to be hashed with Keccak-512.
+    ALWAYS_INLINE hash512 final_mix() noexcept { return le::uint32s(mix); }
 };
 
 hash512 calculate_dataset_item_512(const epoch_context& context, int64_t index) noexcept
@@ -235,12 +452,26 @@ hash1024 calculate_dataset_item_1024(const epoch_context& context, uint32_t inde
     return hash1024{{item0.final(), item1.final()}};
 }
 
+/// Calculates two full dataset items
+///
+/// The Keccak hashes of the four 512-bit items are computed side by side.
 hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t index) noexcept
 {
-    item_state item0{context, int64_t(index) * 4};
-    item_state item1{context, int64_t(index) * 4 + 1};
-    item_state item2{context, int64_t(index) * 4 + 2};
-    item_state item3{context, int64_t(index) * 4 + 3};
+    const int64_t index0 = int64_t(index) * 4;
+
+    hash512 mixes[4] = {
+        item_state::init_mix(context, index0),
+        item_state::init_mix(context, index0 + 1),
+        item_state::init_mix(context, index0 + 2),
+        item_state::init_mix(context, index0 + 3),
+    };
+    hash512 hashes[4];
+    keccak512_x4(hashes, mixes);
+
+    item_state item0{context, index0, hashes[0]};
+    item_state item1{context, index0 + 1, hashes[1]};
+    item_state item2{context, index0 + 2, hashes[2]};
+    item_state item3{context, index0 + 3, hashes[3]};
 
     for (uint32_t j = 0; j < full_dataset_item_parents; ++j)
     {
@@ -250,7 +481,13 @@ hash2048 calculate_dataset_item_2048(const epoch_context& context, uint32_t inde
         item3.update(j);
     }
 
-    return hash2048{{item0.final(), item1.final(), item2.final(), item3.final()}};
+    mixes[0] = item0.final_mix();
+    mixes[1] = item1.final_mix();
+    mixes[2] = item2.final_mix();
+    mixes[3] = item3.final_mix();
+    keccak512_x4(hashes, mixes);
+
+    return hash2048{{hashes[0], hashes[1], hashes[2], hashes[3]}};
 }
 
 namespace
@@ -275,6 +512,22 @@ inline hash256 hash_final(const hash512& seed, const hash256& mix_hash)
     return keccak256(final_data, sizeof(final_data));
 }
 
+inline hash256 compress_mix(const hash1024& mix) noexcept
+{
+    static constexpr size_t num_words = sizeof(hash1024) / sizeof(uint32_t);
+
+    hash256 mix_hash;
+    for (size_t i = 0; i < num_words; i += 4)
+    {
+        const uint32_t h1 = fnv1(mix.word32s[i], mix.word32s[i + 1]);
+        const uint32_t h2 = fnv1(h1, mix.word32s[i + 2]);
+        const uint32_t h3 = fnv1(h2, mix.word32s[i + 3]);
+        mix_hash.word32s[i / 4] = h3;
+    }
+
+    return le::uint32s(mix_hash);
+}
+
 inline hash256 hash_kernel(
     const epoch_context& context, const hash512& seed, lookup_fn lookup) noexcept
 {
@@ -293,63 +546,344 @@ inline hash256 hash_kernel(
             mix.word32s[j] = fnv1(mix.word32s[j], newdata.word32s[j]);
     }
 
-    hash256 mix_hash;
-    for (size_t i = 0; i < num_words; i += 4)
+    return compress_mix(mix);
+}
+
+/// Computes the seeds of four consecutive nonces at once.
+inline void hash_seed_x4(hash512 seeds[4], const hash256& header_hash, uint64_t start_nonce) noexcept
+{
+    uint8_t init_data[4][sizeof(header_hash) + sizeof(start_nonce)];
+    const uint8_t* data[4];
+    for (size_t l = 0; l < 4; ++l)
     {
-        const uint32_t h1 = fnv1(mix.word32s[i], mix.word32s[i + 1]);
-        const uint32_t h2 = fnv1(h1, mix.word32s[i + 2]);
-        const uint32_t h3 = fnv1(h2, mix.word32s[i + 3]);
-        mix_hash.word32s[i / 4] = h3;
+        const uint64_t nonce = le::uint64(start_nonce + l);
+        std::memcpy(&init_data[l][0], &header_hash, sizeof(header_hash));
+        std::memcpy(&init_data[l][sizeof(header_hash)], &nonce, sizeof(nonce));
+        data[l] = init_data[l];
     }
 
-    return le::uint32s(mix_hash);
+    keccak512_x4(seeds, data, sizeof(init_data[0]));
 }
-}  // namespace
 
-result hash(const epoch_context_full& context, const hash256& header_hash, uint64_t nonce) noexcept
+inline void hash_final_x4(
+    hash256 final_hashes[4], const hash512 seeds[4], const hash256 mix_hashes[4]) noexcept
 {
-    static const auto lazy_lookup = [](const epoch_context& ctx, uint32_t index) noexcept
+    uint8_t final_data[4][sizeof(seeds[0]) + sizeof(mix_hashes[0])];
+    const uint8_t* data[4];
+    for (size_t l = 0; l < 4; ++l)
     {
-        auto full_dataset = static_cast<const epoch_context_full&>(ctx).full_dataset;
-        hash1024& item = full_dataset[index];
-        if (item.word64s[0] == 0)
+        std::memcpy(&final_data[l][0], seeds[l].bytes, sizeof(seeds[l]));
+        std::memcpy(&final_data[l][sizeof(seeds[l])], mix_hashes[l].bytes, sizeof(mix_hashes[l]));
+        data[l] = final_data[l];
+    }
+
+    keccak256_x4(final_hashes, data, sizeof(final_data[0]));
+}
+
+hash1024 lazy_lookup(const epoch_context& context, uint32_t index) noexcept
+{
+    const auto& full_ctx = static_cast<const epoch_context_full&>(context);
+    const uint32_t word = index / 32;
+    const uint32_t bit = uint32_t{1} << (index % 32);
+
+    if (full_ctx.full_dataset_ready[word].load(std::memory_order_acquire) & bit)
+        return full_ctx.full_dataset[index];
+
+    // Not generated yet. Only the first thread claiming the item stores it,
+    // racing threads use their own copy.
+    const hash1024 item = calculate_dataset_item_1024(context, index);
+    if (!(full_ctx.full_dataset_claimed[word].fetch_or(bit, std::memory_order_relaxed) & bit))
+    {
+        full_ctx.full_dataset[index] = item;
+        full_ctx.full_dataset_ready[word].fetch_or(bit, std::memory_order_release);
+    }
+    return item;
+}
+
+/// The hash_kernel() of @p batch_size seeds at once.
+///
+/// The lanes advance in lockstep through the dataset accesses. All the items of
+/// one access round are prefetched before the first of them is mixed in, so the
+/// DRAM latencies of the lanes overlap instead of adding up.
+void hash_kernel_batched(const epoch_context_full& context, const hash512 seeds[],
+    hash256 mix_hashes[], size_t batch_size) noexcept
+{
+    static constexpr size_t num_words = sizeof(hash1024) / sizeof(uint32_t);
+    const uint32_t index_limit = static_cast<uint32_t>(context.full_dataset_num_items);
+
+    hash1024 mixes[max_search_batch_size];
+    uint32_t seed_inits[max_search_batch_size];
+    uint32_t indexes[max_search_batch_size];
+
+    for (size_t l = 0; l < batch_size; ++l)
+    {
+        seed_inits[l] = le::uint32(seeds[l].word32s[0]);
+        mixes[l] = hash1024{{le::uint32s(seeds[l]), le::uint32s(seeds[l])}};
+    }
+
+    for (uint32_t i = 0; i < num_dataset_accesses; ++i)
+    {
+        for (size_t l = 0; l < batch_size; ++l)
         {
-            // TODO: Copy elision here makes it thread-safe?
-            item = calculate_dataset_item_1024(ctx, index);
+            indexes[l] = fnv1(i ^ seed_inits[l], mixes[l].word32s[i % num_words]) % index_limit;
+            const hash1024* item = &context.full_dataset[indexes[l]];
+            __builtin_prefetch(item->bytes);
+            __builtin_prefetch(item->bytes + 64);
         }
 
-        return item;
-    };
+        for (size_t l = 0; l < batch_size; ++l)
+        {
+            const hash1024 newdata = le::uint32s(lazy_lookup(context, indexes[l]));
+            for (size_t j = 0; j < num_words; ++j)
+                mixes[l].word32s[j] = fnv1(mixes[l].word32s[j], newdata.word32s[j]);
+        }
+    }
 
+    for (size_t l = 0; l < batch_size; ++l)
+        mix_hashes[l] = compress_mix(mixes[l]);
+}
+
+/// Searches the nonce range hashing four nonces at a time, so that the Keccak
+/// hashes of the seeds and the final hashes are batched.
+search_result search_range(const epoch_context& context, lookup_fn lookup,
+    const hash256& header_hash, const hash256& boundary, uint64_t start_nonce,
+    size_t iterations) noexcept
+{
+    const uint64_t end_nonce = start_nonce + iterations;
+    uint64_t nonce = start_nonce;
+    for (; end_nonce - nonce >= 4; nonce += 4)
+    {
+        hash512 seeds[4];
+        hash256 mix_hashes[4];
+        hash256 final_hashes[4];
+
+        hash_seed_x4(seeds, header_hash, nonce);
+        for (size_t l = 0; l < 4; ++l)
+            mix_hashes[l] = hash_kernel(context, seeds[l], lookup);
+        hash_final_x4(final_hashes, seeds, mix_hashes);
+
+        for (size_t l = 0; l < 4; ++l)
+        {
+            if (is_less_or_equal(final_hashes[l], boundary))
+                return {result{final_hashes[l], mix_hashes[l]}, nonce + l};
+        }
+    }
+
+    for (; nonce != end_nonce; ++nonce)
+    {
+        const hash512 seed = hash_seed(header_hash, nonce);
+        const hash256 mix_hash = hash_kernel(context, seed, lookup);
+        const hash256 final_hash = hash_final(seed, mix_hash);
+        if (is_less_or_equal(final_hash, boundary))
+            return {result{final_hash, mix_hash}, nonce};
+    }
+    return {};
+}
+}  // namespace
+
+result hash(const epoch_context_full& context, const hash256& header_hash, uint64_t nonce) noexcept
+{
     const hash512 seed = hash_seed(header_hash, nonce);
     const hash256 mix_hash = hash_kernel(context, seed, lazy_lookup);
     return {hash_final(seed, mix_hash), mix_hash};
 }
 
-search_result search_light(const epoch_context& context, const hash256& header_hash,
-    const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept
+bool generate_full_dataset(epoch_context_full& context, unsigned num_threads,
+    dataset_progress_fn progress, void* user_data) noexcept
 {
-    const uint64_t end_nonce = start_nonce + iterations;
-    for (uint64_t nonce = start_nonce; nonce < end_nonce; ++nonce)
+    static_assert(full_dataset_chunk_items % 32 == 0, "chunks must cover whole bitmap words");
+
+    const int num_items = context.full_dataset_num_items;
+    const int num_chunks = (num_items + full_dataset_chunk_items - 1) / full_dataset_chunk_items;
+
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > static_cast<unsigned>(num_chunks))
+        num_threads = static_cast<unsigned>(num_chunks);
+
+    std::atomic<int> next_chunk{0};
+    std::atomic<int> items_done{0};
+    std::atomic<bool> cancelled{false};
+
+    // Takes chunks off the shared counter until none is left. Returns false
+    // when the dataset has been fully handed out or generation was cancelled.
+    const auto generate_chunk = [&]() noexcept {
+        if (cancelled.load(std::memory_order_relaxed))
+            return false;
+
+        const int chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= num_chunks)
+            return false;
+
+        const int begin = chunk * full_dataset_chunk_items;
+        const int end = std::min(begin + full_dataset_chunk_items, num_items);
+
+        // Items already generated by lazy lookups are skipped, so a context
+        // created for lazy lookups can be completed in place.
+        generate_full_dataset_items(context, begin, end);
+
+        items_done.fetch_add(end - begin, std::memory_order_relaxed);
+        return true;
+    };
+
+    std::vector<std::thread> workers;
+    try
     {
-        result r = hash(context, header_hash, nonce);
-        if (is_less_or_equal(r.final_hash, boundary))
-            return {r, nonce};
+        workers.reserve(num_threads - 1);
+        for (unsigned t = 1; t < num_threads; ++t)
+            workers.emplace_back([&generate_chunk] {
+                while (generate_chunk())
+                {
+                }
+            });
+    }
+    catch (...)
+    {
+        // Could not spawn (all) workers, the calling thread does the rest.
+    }
+
+    // The calling thread takes part in the generation and is the only one
+    // reporting progress.
+    while (generate_chunk())
+    {
+        if (progress && !progress(items_done.load(std::memory_order_relaxed), num_items, user_data))
+            cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    if (cancelled.load(std::memory_order_relaxed))
+        return false;
+
+    if (progress)
+        progress(num_items, num_items, user_data);
+    return true;
+}
+
+void generate_full_dataset_items(const epoch_context_full& context, int begin, int end) noexcept
+{
+    begin = std::max(begin, 0);
+    end = std::min(end, context.full_dataset_num_items);
+
+    // Claim the items of each bitmap word nobody claimed yet and generate
+    // them, two 1024-bit items at once where both are ours.
+    for (int w = begin / 32; w * 32 < end; ++w)
+    {
+        const int first = std::max(begin, w * 32);
+        const int last = std::min(end, w * 32 + 32);
+        const int n = last - first;
+        const uint32_t range = (n >= 32 ? ~uint32_t{0} : (uint32_t{1} << n) - 1) << (first % 32);
+        const uint32_t owned =
+            ~context.full_dataset_claimed[w].fetch_or(range, std::memory_order_relaxed) & range;
+        if (!owned)
+            continue;
+
+        for (int i = first; i < last;)
+        {
+            const uint32_t bit = uint32_t{1} << (i % 32);
+            if (!(owned & bit))
+            {
+                ++i;
+                continue;
+            }
+            if (i % 2 == 0 && i + 1 < last && (owned & (bit << 1)))
+            {
+                const hash2048 item = calculate_dataset_item_2048(context, static_cast<uint32_t>(i / 2));
+                std::memcpy(&context.full_dataset[i], &item, sizeof(item));
+                i += 2;
+            }
+            else
+            {
+                context.full_dataset[i] = calculate_dataset_item_1024(context, static_cast<uint32_t>(i));
+                ++i;
+            }
+        }
+        context.full_dataset_ready[w].fetch_or(owned, std::memory_order_release);
+    }
+
+    // The items claimed by other threads are being stored, wait for them.
+    for (int w = begin / 32; w * 32 < end; ++w)
+    {
+        const int first = std::max(begin, w * 32);
+        const int n = std::min(end, w * 32 + 32) - first;
+        const uint32_t range = (n >= 32 ? ~uint32_t{0} : (uint32_t{1} << n) - 1) << (first % 32);
+        while ((context.full_dataset_ready[w].load(std::memory_order_acquire) & range) != range)
+            std::this_thread::yield();
     }
-    return {};
+}
+
+bool is_full_dataset_generated(const epoch_context_full& context) noexcept
+{
+    const int num_items = context.full_dataset_num_items;
+    for (int w = 0; w * 32 < num_items; ++w)
+    {
+        const int n = num_items - w * 32;
+        const uint32_t bits = n >= 32 ? ~uint32_t{0} : (uint32_t{1} << n) - 1;
+        if ((context.full_dataset_ready[w].load(std::memory_order_acquire) & bits) != bits)
+            return false;
+    }
+    return true;
+}
+
+search_result search_light(const epoch_context& context, const hash256& header_hash,
+    const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept
+{
+    return search_range(
+        context, calculate_dataset_item_1024, header_hash, boundary, start_nonce, iterations);
 }
 
 search_result search(const epoch_context_full& context, const hash256& header_hash,
     const hash256& boundary, uint64_t start_nonce, size_t iterations) noexcept
 {
+    return search_range(context, lazy_lookup, header_hash, boundary, start_nonce, iterations);
+}
+
+int get_search_batch_size() noexcept
+{
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    // CPUs with AVX2 have the 4-lane Keccak and enough outstanding cache misses
+    // per core to keep 8 lanes busy.
+    static const int batch_size = __builtin_cpu_supports("avx2") ? 8 : 4;
+    return batch_size;
+#else
+    return 4;
+#endif
+}
+
+search_result search_batched(const epoch_context_full& context, const hash256& header_hash,
+    const hash256& boundary, uint64_t start_nonce, size_t iterations, int batch_size) noexcept
+{
+    if (batch_size <= 0)
+        batch_size = get_search_batch_size();
+    batch_size = std::min(std::max(batch_size, 4), max_search_batch_size) & ~3;
+    const uint64_t batch = static_cast<uint64_t>(batch_size);
+
     const uint64_t end_nonce = start_nonce + iterations;
-    for (uint64_t nonce = start_nonce; nonce < end_nonce; ++nonce)
+    uint64_t nonce = start_nonce;
+    for (; end_nonce - nonce >= batch; nonce += batch)
     {
-        result r = hash(context, header_hash, nonce);
-        if (is_less_or_equal(r.final_hash, boundary))
-            return {r, nonce};
+        hash512 seeds[max_search_batch_size];
+        hash256 mix_hashes[max_search_batch_size];
+        hash256 final_hashes[max_search_batch_size];
+
+        for (size_t l = 0; l < batch; l += 4)
+            hash_seed_x4(&seeds[l], header_hash, nonce + l);
+        hash_kernel_batched(context, seeds, mix_hashes, batch);
+        for (size_t l = 0; l < batch; l += 4)
+            hash_final_x4(&final_hashes[l], &seeds[l], &mix_hashes[l]);
+
+        for (size_t l = 0; l < batch; ++l)
+        {
+            if (is_less_or_equal(final_hashes[l], boundary))
+                return {result{final_hashes[l], mix_hashes[l]}, nonce + l};
+        }
     }
-    return {};
+
+    return search_range(context, lazy_lookup, header_hash, boundary, nonce,
+        static_cast<size_t>(end_nonce - nonce));
 }
 }  // namespace ethash
 
@@ -359,8 +893,13 @@ extern "C" {
 
 ethash_hash256 ethash_calculate_epoch_seed(int epoch_number) noexcept
 {
-    ethash_hash256 epoch_seed = {};
-    for (int i = 0; i < epoch_number; ++i)
+    if (epoch_number <= 0)
+        return {};
+
+    // Continue from the last indexed seed beyond the index.
+    const int indexed = std::min(epoch_number, num_indexed_epochs - 1);
+    ethash_hash256 epoch_seed = get_epoch_seed_index().seed(indexed);
+    for (int i = indexed; i < epoch_number; ++i)
         epoch_seed = ethash_keccak256_32(epoch_seed.bytes);
     return epoch_seed;
 }
@@ -375,9 +914,11 @@ int ethash_calculate_light_cache_num_items(int epoch_number) noexcept
     static_assert(
         light_cache_growth % item_size == 0, "light_cache_growth not multiple of item size");
 
-    int num_items_upper_bound = num_items_init + epoch_number * num_items_growth;
-    int num_items = ethash_find_largest_prime(num_items_upper_bound);
-    return num_items;
+    // The prime search takes ~ 0.05 ms, do it once per epoch.
+    return get_memoized_num_items(light_cache_num_items_table, epoch_number, [](int e) noexcept {
+        int num_items_upper_bound = num_items_init + e * num_items_growth;
+        return ethash_find_largest_prime(num_items_upper_bound);
+    });
 }
 
 int ethash_calculate_full_dataset_num_items(int epoch_number) noexcept
@@ -390,9 +931,11 @@ int ethash_calculate_full_dataset_num_items(int epoch_number) noexcept
     static_assert(
         full_dataset_growth % item_size == 0, "full_dataset_growth not multiple of item size");
 
-    int num_items_upper_bound = num_items_init + epoch_number * num_items_growth;
-    int num_items = ethash_find_largest_prime(num_items_upper_bound);
-    return num_items;
+    // The prime search takes ~ 0.05 ms, do it once per epoch.
+    return get_memoized_num_items(full_dataset_num_items_table, epoch_number, [](int e) noexcept {
+        int num_items_upper_bound = num_items_init + e * num_items_growth;
+        return ethash_find_largest_prime(num_items_upper_bound);
+    });
 }
 
 epoch_context* ethash_create_epoch_context(int epoch_number) noexcept
@@ -405,6 +948,43 @@ epoch_context_full* ethash_create_epoch_context_full(int epoch_number) noexcept
     return generic::create_epoch_context(build_light_cache, epoch_number, true);
 }
 
+epoch_context_full* ethash_generate_epoch_context_full(int epoch_number, unsigned num_threads,
+    ethash_dataset_progress_fn progress, void* user_data) noexcept
+{
+    epoch_context_full* context =
+        generic::create_epoch_context(build_light_cache, epoch_number, true);
+    if (!context)
+        return nullptr;
+
+    if (!generate_full_dataset(*context, num_threads, progress, user_data))
+    {
+        ethash_destroy_epoch_context_full(context);
+        return nullptr;
+    }
+    return context;
+}
+
+void ethash_generate_full_dataset_items(const epoch_context_full* context, int begin, int end) noexcept
+{
+    generate_full_dataset_items(*context, begin, end);
+}
+
+const hash1024* ethash_get_full_dataset(const epoch_context_full* context) noexcept
+{
+    return context->full_dataset;
+}
+
+epoch_context_full* ethash_copy_epoch_context_full(
+    const epoch_context_full* context, int numa_node) noexcept
+{
+    return create_epoch_context_copy(*context, numa_node);
+}
+
+void ethash_set_numa_interleave(bool interleave) noexcept
+{
+    set_numa_interleave(interleave);
+}
+
 void ethash_destroy_epoch_context_full(epoch_context_full* context) noexcept
 {
     ethash_destroy_epoch_context(context);
@@ -412,8 +992,17 @@ void ethash_destroy_epoch_context_full(epoch_context_full* context) noexcept
 
 void ethash_destroy_epoch_context(epoch_context* context) noexcept
 {
+    // All contexts are allocated as full ones.
+    const auto* const full = static_cast<const epoch_context_full*>(context);
+    const size_t alloc_size = full->alloc_size;
+    const ethash_page_mode alloc_mode = full->alloc_mode;
     context->~epoch_context();
-    std::free(context);
+    free_epoch_memory(context, alloc_size, alloc_mode);
+}
+
+ethash_page_mode ethash_get_epoch_context_page_mode(const epoch_context* context) noexcept
+{
+    return get_page_mode(*context);
 }
 
 ethash_result ethash_hash(
@@ -2,10 +2,17 @@
 // Copyright 2018-2019 Pawel Bylica.
 // Licensed under the Apache License, Version 2.0.
 
+#include "epoch_store.hpp"
 #include "ethash-internal.hpp"
 
+#include <atomic>
+#include <functional>
+#include <future>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 
 #if !defined(__has_cpp_attribute)
 #define __has_cpp_attribute(x) 0
@@ -23,60 +30,253 @@ using namespace ethash;
 
 namespace
 {
-std::mutex shared_context_mutex;
-std::shared_ptr<epoch_context> shared_context;
-thread_local std::shared_ptr<epoch_context> thread_local_context;
+/// The least recently used cache of the shared epoch contexts.
+///
+/// A context is built outside of the cache lock, so only the threads asking
+/// for the same epoch wait for it. The contexts evicted from the cache stay
+/// alive as long as some thread still holds them.
+template <typename Context>
+class context_cache
+{
+public:
+    using context_ptr = std::shared_ptr<Context>;
+    using build_fn = std::function<context_ptr()>;
+
+    explicit context_cache(size_t capacity) noexcept : capacity_{capacity} {}
+
+    /// Returns the context of the epoch, building it with @p build on a miss.
+    /// Failed builds are not cached.
+    context_ptr get(int epoch_number, const build_fn& build)
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+
+        auto it = find(epoch_number);
+        if (it != entries_.end())
+        {
+            entries_.splice(entries_.begin(), entries_, it);
+            std::shared_future<context_ptr> context = it->context;
+            lock.unlock();
+            return context.get();
+        }
+
+        std::promise<context_ptr> promise;
+        try
+        {
+            entries_.push_front({epoch_number, promise.get_future().share()});
+        }
+        catch (...)
+        {
+            return {};
+        }
+        evict();
+        lock.unlock();
+
+        // A failed build is cached as a null context, so threads waiting for
+        // it do not get a broken promise, and the entry is erased below.
+        context_ptr context;
+        try
+        {
+            context = build();
+        }
+        catch (...)
+        {
+        }
+        promise.set_value(context);
+
+        if (!context)
+        {
+            lock.lock();
+            it = find(epoch_number);
+            if (it != entries_.end() && is_ready(it->context) && !it->context.get())
+                entries_.erase(it);
+        }
+        return context;
+    }
+
+    /// Returns the context of the epoch if it is already built, never blocks.
+    context_ptr try_get(int epoch_number)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+
+        auto it = find(epoch_number);
+        if (it == entries_.end() || !is_ready(it->context))
+            return {};
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->context.get();
+    }
+
+    /// Checks if the context of the epoch is cached or being built.
+    bool contains(int epoch_number)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return find(epoch_number) != entries_.end();
+    }
+
+    void set_capacity(size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        capacity_ = capacity > 0 ? capacity : 1;
+        evict();
+    }
+
+private:
+    struct entry
+    {
+        int epoch_number;
+        std::shared_future<context_ptr> context;
+    };
+
+    static bool is_ready(const std::shared_future<context_ptr>& context)
+    {
+        return context.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+    }
+
+    typename std::list<entry>::iterator find(int epoch_number)
+    {
+        for (auto it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            if (it->epoch_number == epoch_number)
+                return it;
+        }
+        return entries_.end();
+    }
 
-std::mutex shared_context_full_mutex;
-std::shared_ptr<epoch_context_full> shared_context_full;
+    void evict()
+    {
+        while (entries_.size() > capacity_)
+            entries_.pop_back();
+    }
+
+    std::mutex mutex_;
+    std::list<entry> entries_;  ///< Most recently used first.
+    size_t capacity_;
+};
+
+/// The caches are never destroyed, the background builders may outlive main().
+context_cache<epoch_context>& shared_contexts()
+{
+    static auto& cache = *new context_cache<epoch_context>{4};
+    return cache;
+}
+
+context_cache<epoch_context_full>& shared_contexts_full()
+{
+    static auto& cache = *new context_cache<epoch_context_full>{1};
+    return cache;
+}
+
+thread_local std::shared_ptr<epoch_context> thread_local_context;
 thread_local std::shared_ptr<epoch_context_full> thread_local_context_full;
+thread_local bool thread_local_context_full_generated = false;
+
+/// Lets one thread at a time complete a lazily created full context.
+std::mutex complete_context_full_mutex;
+
+std::mutex store_dir_mutex;
+std::string store_dir;
+std::atomic<bool> store_verify{false};
+
+std::string get_store_dir()
+{
+    std::lock_guard<std::mutex> lock{store_dir_mutex};
+    return store_dir;
+}
+
+std::shared_ptr<epoch_context> build_context(int epoch_number)
+{
+    // Map the stored light cache or build and store a new one.
+    const std::string dir = get_store_dir();
+    std::shared_ptr<epoch_context> context;
+    if (!dir.empty())
+        context = store::load_epoch_context(dir, epoch_number);
+    if (!context)
+    {
+        context = create_epoch_context(epoch_number);
+        if (context && !dir.empty())
+            store::save_epoch_context(dir, *context);
+    }
+    return context;
+}
+
+/// Writes the dataset to the store on a detached thread, so that the threads
+/// waiting for the context don't wait for the disk too. The thread holds the
+/// context until the file is written.
+void save_context_full_in_background(const std::string& dir, std::shared_ptr<epoch_context_full> context)
+{
+    try
+    {
+        std::thread{[dir, context] { store::save_epoch_context_full(dir, *context); }}.detach();
+    }
+    catch (...)
+    {
+        // Not stored, the next run builds the dataset again.
+    }
+}
+
+std::shared_ptr<epoch_context_full> build_context_full(
+    int epoch_number, bool generate, unsigned num_threads, dataset_progress_fn progress, void* user_data)
+{
+    // Map the stored dataset or build a new context. Only completely
+    // generated datasets are stored.
+    const std::string dir = get_store_dir();
+    std::shared_ptr<epoch_context_full> context;
+    if (!dir.empty())
+        context = store::load_epoch_context_full(dir, epoch_number, store_verify.load());
+    if (!context)
+    {
+        if (generate)
+        {
+            context = generate_epoch_context_full(epoch_number, num_threads, progress, user_data);
+            if (context && !dir.empty())
+                save_context_full_in_background(dir, context);
+        }
+        else
+            context = create_epoch_context_full(epoch_number);
+    }
+    return context;
+}
 
 /// Update thread local epoch context.
 ///
 /// This function is on the slow path. It's separated to allow inlining the fast
 /// path.
-///
-/// @todo: Redesign to guarantee deallocation before new allocation.
 ATTRIBUTE_NOINLINE
 void update_local_context(int epoch_number)
 {
     // Release the shared pointer of the obsoleted context.
     thread_local_context.reset();
 
-    // Local context invalid, check the shared context.
-    std::lock_guard<std::mutex> lock{shared_context_mutex};
-
-    if (!shared_context || shared_context->epoch_number != epoch_number)
-    {
-        // Release the shared pointer of the obsoleted context.
-        shared_context.reset();
-
-        // Build new context.
-        shared_context = create_epoch_context(epoch_number);
-    }
-
-    thread_local_context = shared_context;
+    thread_local_context =
+        shared_contexts().get(epoch_number, [epoch_number] { return build_context(epoch_number); });
 }
 
 ATTRIBUTE_NOINLINE
-void update_local_context_full(int epoch_number)
+void update_local_context_full(
+    int epoch_number, bool generate, unsigned num_threads, dataset_progress_fn progress, void* user_data)
 {
     // Release the shared pointer of the obsoleted context.
     thread_local_context_full.reset();
 
-    // Local context invalid, check the shared context.
-    std::lock_guard<std::mutex> lock{shared_context_full_mutex};
+    std::shared_ptr<epoch_context_full> context = shared_contexts_full().get(epoch_number, [=] {
+        return build_context_full(epoch_number, generate, num_threads, progress, user_data);
+    });
 
-    if (!shared_context_full || shared_context_full->epoch_number != epoch_number)
+    // The cached context may have been created for lazy lookups. Complete it
+    // in place rather than building a second dataset of the same epoch.
+    if (context && generate && !is_full_dataset_generated(*context))
     {
-        // Release the shared pointer of the obsoleted context.
-        shared_context_full.reset();
-
-        // Build new context.
-        shared_context_full = create_epoch_context_full(epoch_number);
+        std::lock_guard<std::mutex> lock{complete_context_full_mutex};
+        if (!is_full_dataset_generated(*context))
+        {
+            const std::string dir = get_store_dir();
+            if (!generate_full_dataset(*context, num_threads, progress, user_data))
+                context.reset();
+            else if (!dir.empty())
+                save_context_full_in_background(dir, context);
+        }
     }
-
-    thread_local_context_full = shared_context_full;
+    thread_local_context_full_generated = generate && context;
+    thread_local_context_full = std::move(context);
 }
 }  // namespace
 
@@ -93,7 +293,89 @@ const ethash_epoch_context_full* ethash_get_global_epoch_context_full(int epoch_
 {
     // Check if local context matches epoch number.
     if (!thread_local_context_full || thread_local_context_full->epoch_number != epoch_number)
-        update_local_context_full(epoch_number);
+        update_local_context_full(epoch_number, false, 0, nullptr, nullptr);
+
+    return thread_local_context_full.get();
+}
+
+const ethash_epoch_context_full* ethash_get_global_epoch_context_full_generated(int epoch_number,
+    unsigned num_threads, ethash_dataset_progress_fn progress, void* user_data) noexcept
+{
+    // Check if local context matches epoch number.
+    if (!thread_local_context_full || thread_local_context_full->epoch_number != epoch_number ||
+        !thread_local_context_full_generated)
+        update_local_context_full(epoch_number, true, num_threads, progress, user_data);
+
+    return thread_local_context_full.get();
+}
+
+const ethash_epoch_context* ethash_try_get_global_epoch_context(int epoch_number) noexcept
+{
+    if (!thread_local_context || thread_local_context->epoch_number != epoch_number)
+    {
+        std::shared_ptr<epoch_context> context = shared_contexts().try_get(epoch_number);
+        if (!context)
+            return nullptr;
+        thread_local_context = std::move(context);
+    }
+    return thread_local_context.get();
+}
 
+const ethash_epoch_context_full* ethash_try_get_global_epoch_context_full(int epoch_number) noexcept
+{
+    if (!thread_local_context_full || thread_local_context_full->epoch_number != epoch_number)
+    {
+        std::shared_ptr<epoch_context_full> context = shared_contexts_full().try_get(epoch_number);
+        if (!context)
+            return nullptr;
+        thread_local_context_full_generated = false;
+        thread_local_context_full = std::move(context);
+    }
     return thread_local_context_full.get();
 }
+
+void ethash_prebuild_global_epoch_context(int epoch_number) noexcept
+{
+    if (shared_contexts().contains(epoch_number))
+        return;
+
+    try
+    {
+        std::thread{[epoch_number] {
+            shared_contexts().get(epoch_number, [epoch_number] { return build_context(epoch_number); });
+        }}.detach();
+    }
+    catch (...)
+    {
+        // The context is built on demand instead.
+    }
+}
+
+void ethash_set_global_epoch_context_cache_size(unsigned num_contexts, unsigned num_contexts_full) noexcept
+{
+    shared_contexts().set_capacity(num_contexts);
+    shared_contexts_full().set_capacity(num_contexts_full);
+}
+
+void ethash_set_epoch_store_dir(const char* dir) noexcept
+{
+    std::lock_guard<std::mutex> lock{store_dir_mutex};
+    store_dir = dir ? dir : "";
+}
+
+void ethash_set_epoch_store_verify(bool verify) noexcept
+{
+    store_verify = verify;
+}
+
+std::shared_ptr<const epoch_context> ethash::get_global_epoch_context_shared(int epoch_number) noexcept
+{
+    return shared_contexts().get(epoch_number, [epoch_number] { return build_context(epoch_number); });
+}
+
+std::shared_ptr<const epoch_context_full> ethash::get_global_epoch_context_full_shared(
+    int epoch_number) noexcept
+{
+    return shared_contexts_full().get(epoch_number,
+        [epoch_number] { return build_context_full(epoch_number, false, 0, nullptr, nullptr); });
+}
@@ -283,18 +283,6 @@ __attribute__((target("bmi,bmi2"))) static void keccakf1600_bmi(uint64_t state[2
 {
     keccakf1600_implementation(state);
 }
-
-__attribute__((constructor)) static void select_keccakf1600_implementation()
-{
-    // Init CPU information.
-    // This is needed on macOS because of the bug: https://bugs.llvm.org/show_bug.cgi?id=48459.
-    __builtin_cpu_init();
-
-    // Check if both BMI and BMI2 are supported. Some CPUs like Intel E5-2697 v2 incorrectly
-    // report BMI2 but not BMI being available.
-    if (__builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2"))
-        keccakf1600_best = keccakf1600_bmi;
-}
 #endif
 
 
@@ -353,6 +341,104 @@ static inline ALWAYS_INLINE void keccak(
         out[i] = to_le64(state[i]);
 }
 
+/// The Keccak sponge hashing several messages of the same size at once.
+typedef void (*keccak_lanes_fn)(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size);
+
+static void keccak_x4_generic(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size)
+{
+    for (size_t l = 0; l < 4; ++l)
+        keccak(out[l], bits, data[l], size);
+}
+
+static void keccak_x8_generic(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size)
+{
+    for (size_t l = 0; l < 8; ++l)
+        keccak(out[l], bits, data[l], size);
+}
+
+/// The pointers to the best 4- and 8-lane Keccak implementations,
+/// selected during runtime initialization.
+static keccak_lanes_fn keccak_x4_best = keccak_x4_generic;
+static keccak_lanes_fn keccak_x8_best = keccak_x8_generic;
+
+
+#if defined(__x86_64__) && __has_attribute(target) && !defined(_MSC_VER)
+typedef uint64_t keccak_lanes_x2 __attribute__((vector_size(16)));
+typedef uint64_t keccak_lanes_x4 __attribute__((vector_size(32)));
+typedef uint64_t keccak_lanes_x8 __attribute__((vector_size(64)));
+
+#define KECCAK_LANES 2
+#define KECCAK_LANE_T keccak_lanes_x2
+#define KECCAK_TARGET __attribute__((target("sse2")))
+#define KECCAK_PERMUTE keccakf1600_x2_sse2
+#define KECCAK_SPONGE keccak_x2_sse2
+#include "keccakf1600_lanes.h"
+
+#define KECCAK_LANES 4
+#define KECCAK_LANE_T keccak_lanes_x4
+#define KECCAK_TARGET __attribute__((target("avx2")))
+#define KECCAK_PERMUTE keccakf1600_x4_avx2
+#define KECCAK_SPONGE keccak_x4_avx2
+#include "keccakf1600_lanes.h"
+
+#define KECCAK_LANES 8
+#define KECCAK_LANE_T keccak_lanes_x8
+#define KECCAK_TARGET __attribute__((target("avx512f")))
+#define KECCAK_PERMUTE keccakf1600_x8_avx512
+#define KECCAK_SPONGE keccak_x8_avx512
+#include "keccakf1600_lanes.h"
+
+static void keccak_x4_sse2(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size)
+{
+    keccak_x2_sse2(out, bits, data, size);
+    keccak_x2_sse2(out + 2, bits, data + 2, size);
+}
+
+static void keccak_x8_sse2(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size)
+{
+    keccak_x4_sse2(out, bits, data, size);
+    keccak_x4_sse2(out + 4, bits, data + 4, size);
+}
+
+static void keccak_x8_avx2(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size)
+{
+    keccak_x4_avx2(out, bits, data, size);
+    keccak_x4_avx2(out + 4, bits, data + 4, size);
+}
+
+__attribute__((constructor)) static void select_keccakf1600_implementation()
+{
+    // Init CPU information.
+    // This is needed on macOS because of the bug: https://bugs.llvm.org/show_bug.cgi?id=48459.
+    __builtin_cpu_init();
+
+    // Check if both BMI and BMI2 are supported. Some CPUs like Intel E5-2697 v2 incorrectly
+    // report BMI2 but not BMI being available.
+    if (__builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2"))
+        keccakf1600_best = keccakf1600_bmi;
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        keccak_x4_best = keccak_x4_avx2;
+        keccak_x8_best = keccak_x8_avx2;
+    }
+    else
+    {
+        keccak_x4_best = keccak_x4_sse2;
+        keccak_x8_best = keccak_x8_sse2;
+    }
+
+    if (__builtin_cpu_supports("avx512f"))
+        keccak_x8_best = keccak_x8_avx512;
+}
+#endif
+
 union ethash_hash256 ethash_keccak256(const uint8_t* data, size_t size)
 {
     union ethash_hash256 hash;
@@ -380,3 +466,29 @@ union ethash_hash512 ethash_keccak512_64(const uint8_t data[64])
     keccak(hash.word64s, 512, data, 64);
     return hash;
 }
+
+void ethash_keccak256_x4(union ethash_hash256 out[4], const uint8_t* const data[4], size_t size)
+{
+    uint64_t* const words[4] = {out[0].word64s, out[1].word64s, out[2].word64s, out[3].word64s};
+    keccak_x4_best(words, 256, data, size);
+}
+
+void ethash_keccak512_x4(union ethash_hash512 out[4], const uint8_t* const data[4], size_t size)
+{
+    uint64_t* const words[4] = {out[0].word64s, out[1].word64s, out[2].word64s, out[3].word64s};
+    keccak_x4_best(words, 512, data, size);
+}
+
+void ethash_keccak256_x8(union ethash_hash256 out[8], const uint8_t* const data[8], size_t size)
+{
+    uint64_t* const words[8] = {out[0].word64s, out[1].word64s, out[2].word64s, out[3].word64s,
+        out[4].word64s, out[5].word64s, out[6].word64s, out[7].word64s};
+    keccak_x8_best(words, 256, data, size);
+}
+
+void ethash_keccak512_x8(union ethash_hash512 out[8], const uint8_t* const data[8], size_t size)
+{
+    uint64_t* const words[8] = {out[0].word64s, out[1].word64s, out[2].word64s, out[3].word64s,
+        out[4].word64s, out[5].word64s, out[6].word64s, out[7].word64s};
+    keccak_x8_best(words, 512, data, size);
+}
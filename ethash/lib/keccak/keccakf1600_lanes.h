@@ -0,0 +1,297 @@
+// ethash: C/C++ implementation of Ethash, the Ethereum Proof of Work algorithm.
+// Copyright 2018 Pawel Bylica.
+// SPDX-License-Identifier: Apache-2.0
+
+// The multi-lane Keccak-f[1600] and Keccak sponge template.
+//
+// This file has no include guard. It is included by keccak.c once per
+// lane width with the following macros defined:
+// - KECCAK_LANES     the number of independent states hashed side by side,
+// - KECCAK_LANE_T    the vector type of KECCAK_LANES 64-bit words,
+// - KECCAK_TARGET    the function attributes enabling the instruction set,
+// - KECCAK_PERMUTE   the name of the permutation function to define,
+// - KECCAK_SPONGE    the name of the sponge function to define.
+// All macros are undefined at the end of this file.
+
+#define KECCAK_ROL(x, s) (((x) << (s)) | ((x) >> (64 - (s))))
+
+/// The Keccak-f[1600] function applied to KECCAK_LANES states at once.
+///
+/// Every word of the state holds the same word of all the lanes.
+/// See keccakf1600_implementation() in keccak.c for the reference.
+KECCAK_TARGET static inline ALWAYS_INLINE void KECCAK_PERMUTE(KECCAK_LANE_T state[25])
+{
+    KECCAK_LANE_T Aba, Abe, Abi, Abo, Abu;
+    KECCAK_LANE_T Aga, Age, Agi, Ago, Agu;
+    KECCAK_LANE_T Aka, Ake, Aki, Ako, Aku;
+    KECCAK_LANE_T Ama, Ame, Ami, Amo, Amu;
+    KECCAK_LANE_T Asa, Ase, Asi, Aso, Asu;
+
+    KECCAK_LANE_T Eba, Ebe, Ebi, Ebo, Ebu;
+    KECCAK_LANE_T Ega, Ege, Egi, Ego, Egu;
+    KECCAK_LANE_T Eka, Eke, Eki, Eko, Eku;
+    KECCAK_LANE_T Ema, Eme, Emi, Emo, Emu;
+    KECCAK_LANE_T Esa, Ese, Esi, Eso, Esu;
+
+    KECCAK_LANE_T Ba, Be, Bi, Bo, Bu;
+
+    KECCAK_LANE_T Da, De, Di, Do, Du;
+
+    Aba = state[0];
+    Abe = state[1];
+    Abi = state[2];
+    Abo = state[3];
+    Abu = state[4];
+    Aga = state[5];
+    Age = state[6];
+    Agi = state[7];
+    Ago = state[8];
+    Agu = state[9];
+    Aka = state[10];
+    Ake = state[11];
+    Aki = state[12];
+    Ako = state[13];
+    Aku = state[14];
+    Ama = state[15];
+    Ame = state[16];
+    Ami = state[17];
+    Amo = state[18];
+    Amu = state[19];
+    Asa = state[20];
+    Ase = state[21];
+    Asi = state[22];
+    Aso = state[23];
+    Asu = state[24];
+
+    for (size_t n = 0; n < 24; n += 2)
+    {
+        // Round (n + 0): Axx -> Exx
+
+        Ba = Aba ^ Aga ^ Aka ^ Ama ^ Asa;
+        Be = Abe ^ Age ^ Ake ^ Ame ^ Ase;
+        Bi = Abi ^ Agi ^ Aki ^ Ami ^ Asi;
+        Bo = Abo ^ Ago ^ Ako ^ Amo ^ Aso;
+        Bu = Abu ^ Agu ^ Aku ^ Amu ^ Asu;
+
+        Da = Bu ^ KECCAK_ROL(Be, 1);
+        De = Ba ^ KECCAK_ROL(Bi, 1);
+        Di = Be ^ KECCAK_ROL(Bo, 1);
+        Do = Bi ^ KECCAK_ROL(Bu, 1);
+        Du = Bo ^ KECCAK_ROL(Ba, 1);
+
+        Ba = Aba ^ Da;
+        Be = KECCAK_ROL(Age ^ De, 44);
+        Bi = KECCAK_ROL(Aki ^ Di, 43);
+        Bo = KECCAK_ROL(Amo ^ Do, 21);
+        Bu = KECCAK_ROL(Asu ^ Du, 14);
+        Eba = Ba ^ (~Be & Bi) ^ round_constants[n];
+        Ebe = Be ^ (~Bi & Bo);
+        Ebi = Bi ^ (~Bo & Bu);
+        Ebo = Bo ^ (~Bu & Ba);
+        Ebu = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Abo ^ Do, 28);
+        Be = KECCAK_ROL(Agu ^ Du, 20);
+        Bi = KECCAK_ROL(Aka ^ Da, 3);
+        Bo = KECCAK_ROL(Ame ^ De, 45);
+        Bu = KECCAK_ROL(Asi ^ Di, 61);
+        Ega = Ba ^ (~Be & Bi);
+        Ege = Be ^ (~Bi & Bo);
+        Egi = Bi ^ (~Bo & Bu);
+        Ego = Bo ^ (~Bu & Ba);
+        Egu = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Abe ^ De, 1);
+        Be = KECCAK_ROL(Agi ^ Di, 6);
+        Bi = KECCAK_ROL(Ako ^ Do, 25);
+        Bo = KECCAK_ROL(Amu ^ Du, 8);
+        Bu = KECCAK_ROL(Asa ^ Da, 18);
+        Eka = Ba ^ (~Be & Bi);
+        Eke = Be ^ (~Bi & Bo);
+        Eki = Bi ^ (~Bo & Bu);
+        Eko = Bo ^ (~Bu & Ba);
+        Eku = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Abu ^ Du, 27);
+        Be = KECCAK_ROL(Aga ^ Da, 36);
+        Bi = KECCAK_ROL(Ake ^ De, 10);
+        Bo = KECCAK_ROL(Ami ^ Di, 15);
+        Bu = KECCAK_ROL(Aso ^ Do, 56);
+        Ema = Ba ^ (~Be & Bi);
+        Eme = Be ^ (~Bi & Bo);
+        Emi = Bi ^ (~Bo & Bu);
+        Emo = Bo ^ (~Bu & Ba);
+        Emu = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Abi ^ Di, 62);
+        Be = KECCAK_ROL(Ago ^ Do, 55);
+        Bi = KECCAK_ROL(Aku ^ Du, 39);
+        Bo = KECCAK_ROL(Ama ^ Da, 41);
+        Bu = KECCAK_ROL(Ase ^ De, 2);
+        Esa = Ba ^ (~Be & Bi);
+        Ese = Be ^ (~Bi & Bo);
+        Esi = Bi ^ (~Bo & Bu);
+        Eso = Bo ^ (~Bu & Ba);
+        Esu = Bu ^ (~Ba & Be);
+
+
+        // Round (n + 1): Exx -> Axx
+
+        Ba = Eba ^ Ega ^ Eka ^ Ema ^ Esa;
+        Be = Ebe ^ Ege ^ Eke ^ Eme ^ Ese;
+        Bi = Ebi ^ Egi ^ Eki ^ Emi ^ Esi;
+        Bo = Ebo ^ Ego ^ Eko ^ Emo ^ Eso;
+        Bu = Ebu ^ Egu ^ Eku ^ Emu ^ Esu;
+
+        Da = Bu ^ KECCAK_ROL(Be, 1);
+        De = Ba ^ KECCAK_ROL(Bi, 1);
+        Di = Be ^ KECCAK_ROL(Bo, 1);
+        Do = Bi ^ KECCAK_ROL(Bu, 1);
+        Du = Bo ^ KECCAK_ROL(Ba, 1);
+
+        Ba = Eba ^ Da;
+        Be = KECCAK_ROL(Ege ^ De, 44);
+        Bi = KECCAK_ROL(Eki ^ Di, 43);
+        Bo = KECCAK_ROL(Emo ^ Do, 21);
+        Bu = KECCAK_ROL(Esu ^ Du, 14);
+        Aba = Ba ^ (~Be & Bi) ^ round_constants[n + 1];
+        Abe = Be ^ (~Bi & Bo);
+        Abi = Bi ^ (~Bo & Bu);
+        Abo = Bo ^ (~Bu & Ba);
+        Abu = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Ebo ^ Do, 28);
+        Be = KECCAK_ROL(Egu ^ Du, 20);
+        Bi = KECCAK_ROL(Eka ^ Da, 3);
+        Bo = KECCAK_ROL(Eme ^ De, 45);
+        Bu = KECCAK_ROL(Esi ^ Di, 61);
+        Aga = Ba ^ (~Be & Bi);
+        Age = Be ^ (~Bi & Bo);
+        Agi = Bi ^ (~Bo & Bu);
+        Ago = Bo ^ (~Bu & Ba);
+        Agu = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Ebe ^ De, 1);
+        Be = KECCAK_ROL(Egi ^ Di, 6);
+        Bi = KECCAK_ROL(Eko ^ Do, 25);
+        Bo = KECCAK_ROL(Emu ^ Du, 8);
+        Bu = KECCAK_ROL(Esa ^ Da, 18);
+        Aka = Ba ^ (~Be & Bi);
+        Ake = Be ^ (~Bi & Bo);
+        Aki = Bi ^ (~Bo & Bu);
+        Ako = Bo ^ (~Bu & Ba);
+        Aku = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Ebu ^ Du, 27);
+        Be = KECCAK_ROL(Ega ^ Da, 36);
+        Bi = KECCAK_ROL(Eke ^ De, 10);
+        Bo = KECCAK_ROL(Emi ^ Di, 15);
+        Bu = KECCAK_ROL(Eso ^ Do, 56);
+        Ama = Ba ^ (~Be & Bi);
+        Ame = Be ^ (~Bi & Bo);
+        Ami = Bi ^ (~Bo & Bu);
+        Amo = Bo ^ (~Bu & Ba);
+        Amu = Bu ^ (~Ba & Be);
+
+        Ba = KECCAK_ROL(Ebi ^ Di, 62);
+        Be = KECCAK_ROL(Ego ^ Do, 55);
+        Bi = KECCAK_ROL(Eku ^ Du, 39);
+        Bo = KECCAK_ROL(Ema ^ Da, 41);
+        Bu = KECCAK_ROL(Ese ^ De, 2);
+        Asa = Ba ^ (~Be & Bi);
+        Ase = Be ^ (~Bi & Bo);
+        Asi = Bi ^ (~Bo & Bu);
+        Aso = Bo ^ (~Bu & Ba);
+        Asu = Bu ^ (~Ba & Be);
+    }
+
+    state[0] = Aba;
+    state[1] = Abe;
+    state[2] = Abi;
+    state[3] = Abo;
+    state[4] = Abu;
+    state[5] = Aga;
+    state[6] = Age;
+    state[7] = Agi;
+    state[8] = Ago;
+    state[9] = Agu;
+    state[10] = Aka;
+    state[11] = Ake;
+    state[12] = Aki;
+    state[13] = Ako;
+    state[14] = Aku;
+    state[15] = Ama;
+    state[16] = Ame;
+    state[17] = Ami;
+    state[18] = Amo;
+    state[19] = Amu;
+    state[20] = Asa;
+    state[21] = Ase;
+    state[22] = Asi;
+    state[23] = Aso;
+    state[24] = Asu;
+}
+
+/// The Keccak sponge hashing KECCAK_LANES messages of the same size at once.
+KECCAK_TARGET static void KECCAK_SPONGE(
+    uint64_t* const out[], size_t bits, const uint8_t* const data[], size_t size)
+{
+    static const size_t word_size = sizeof(uint64_t);
+    const size_t hash_size = bits / 8;
+    const size_t block_size = (1600 - bits * 2) / 8;
+
+    size_t i, l;
+    size_t offset = 0;
+    KECCAK_LANE_T state[25];
+    KECCAK_LANE_T word = {0};
+
+    __builtin_memset(state, 0, sizeof(state));
+
+    while (size >= block_size)
+    {
+        for (i = 0; i < (block_size / word_size); ++i)
+        {
+            for (l = 0; l < KECCAK_LANES; ++l)
+                word[l] = load_le(data[l] + offset);
+            state[i] ^= word;
+            offset += word_size;
+        }
+
+        KECCAK_PERMUTE(state);
+
+        size -= block_size;
+    }
+
+    for (i = 0; size >= word_size; ++i)
+    {
+        for (l = 0; l < KECCAK_LANES; ++l)
+            word[l] = load_le(data[l] + offset);
+        state[i] ^= word;
+        offset += word_size;
+        size -= word_size;
+    }
+
+    for (l = 0; l < KECCAK_LANES; ++l)
+    {
+        uint64_t last_word = 0;
+        __builtin_memcpy(&last_word, data[l] + offset, size);
+        ((uint8_t*)&last_word)[size] = 0x01;
+        word[l] = to_le64(last_word);
+    }
+    state[i] ^= word;
+
+    state[(block_size / word_size) - 1] ^= 0x8000000000000000;
+
+    KECCAK_PERMUTE(state);
+
+    for (i = 0; i < (hash_size / word_size); ++i)
+        for (l = 0; l < KECCAK_LANES; ++l)
+            out[l][i] = to_le64(state[i][l]);
+}
+
+#undef KECCAK_ROL
+#undef KECCAK_LANES
+#undef KECCAK_LANE_T
+#undef KECCAK_TARGET
+#undef KECCAK_PERMUTE
+#undef KECCAK_SPONGE
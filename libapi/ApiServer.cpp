@@ -75,6 +75,24 @@ static bool getRequestValue(const char* membername, unsigned& refValue, Json::Va
     return true;
 }
 
+static bool getRequestValue(const char* membername, float& refValue, Json::Value& jRequest, bool optional,
+                            Json::Value& jResponse) {
+    if (!jRequest.isMember(membername)) {
+        if (!optional) {
+            jResponse["error"]["code"] = -32602;
+            jResponse["error"]["message"] = string("Missing '") + string(membername) + string("'");
+        }
+        return optional;
+    }
+    if (!jRequest[membername].isNumeric()) {
+        jResponse["error"]["code"] = -32602;
+        jResponse["error"]["message"] = string("Invalid type of value '") + string(membername) + string("'");
+        return false;
+    }
+    refValue = jRequest[membername].asFloat();
+    return true;
+}
+
 static bool getRequestValue(const char* membername, Json::Value& refValue, Json::Value& jRequest, bool optional,
                             Json::Value& jResponse) {
     if (!jRequest.isMember(membername)) {
@@ -496,6 +514,43 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         }
     }
 
+    else if (_method == "miner_setbatch") {
+        if (!checkApiWriteAccess(m_readonly, jResponse))
+            return;
+
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, false, jResponse))
+            return;
+
+        unsigned index;
+        if (!getRequestValue("index", index, jRequestParams, false, jResponse))
+            return;
+
+        auto const& miner = Farm::f().getMiner(index);
+        if (!miner) {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "Index out of bounds";
+            return;
+        }
+
+        // Unspecified settings stay as they are, risk is in percent
+        BatchStatus batch = miner->batchController().status();
+        float risk = batch.risk * 100, minTime = batch.minTime, maxTime = batch.maxTime;
+        if (!getRequestValue("risk", risk, jRequestParams, true, jResponse) ||
+            !getRequestValue("min", minTime, jRequestParams, true, jResponse) ||
+            !getRequestValue("max", maxTime, jRequestParams, true, jResponse))
+            return;
+        if (risk <= 0 || risk > 50 || minTime <= 0 || maxTime < minTime || maxTime > 10) {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "Settings out of bounds (0 < risk <= 50, 0 < min <= max <= 10)";
+            return;
+        }
+
+        miner->batchController().setRisk(risk / 100);
+        miner->batchController().setLimits(minTime, maxTime);
+        jResponse["result"] = true;
+    }
+
     else if (_method == "miner_setverbosity") {
         if (!checkApiWriteAccess(m_readonly, jResponse))
             return;
@@ -549,6 +604,45 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         jResponse["result"] = Farm::f().get_nonce();
     }
 
+    else if (_method == "miner_getstalls") {
+        jResponse["result"] = getStalls();
+    }
+
+    else if (_method == "miner_gethashratestats" || _method == "miner_gethashrateseries") {
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, true, jResponse))
+            return;
+
+        unsigned span = HR_SERIES_SECONDS;
+        if (!getRequestValue("span", span, jRequestParams, true, jResponse))
+            return;
+        if (!span || span > HR_SERIES_MINUTES * 60) {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "Span out of bounds (1-" + to_string(HR_SERIES_MINUTES * 60) + ")";
+            return;
+        }
+
+        if (_method == "miner_gethashratestats") {
+            jResponse["result"] = getHashRateStats(span);
+            return;
+        }
+
+        // Whole farm unless a device is given
+        Json::Value index;
+        unsigned i;
+        if (!getRequestValue("index", i, jRequestParams, true, jResponse))
+            return;
+        if (jRequestParams.isMember("index")) {
+            if (!Farm::f().getMiner(i)) {
+                jResponse["error"]["code"] = -422;
+                jResponse["error"]["message"] = "Index out of bounds";
+                return;
+            }
+            index = i;
+        }
+        jResponse["result"] = getHashRateSeries(index, span);
+    }
+
     else {
         // Any other method not found
         jResponse["error"]["code"] = -32601;
@@ -749,8 +843,8 @@ void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& e
 
 Json::Value ApiConnection::getMinerStat1() {
     auto connection = PoolManager::p().getActiveConnection();
-    TelemetryType t = Farm::f().Telemetry();
-    auto runningTime = chrono::duration_cast<chrono::minutes>(steady_clock::now() - t.start);
+    auto t = Farm::f().Telemetry();
+    auto runningTime = chrono::duration_cast<chrono::minutes>(steady_clock::now() - t->start);
 
     ostringstream totalMhEth;
     ostringstream totalMhDcr;
@@ -761,23 +855,23 @@ Json::Value ApiConnection::getMinerStat1() {
     ostringstream poolAddresses;
     ostringstream invalidStats;
 
-    totalMhEth << fixed << setprecision(0) << t.farm.hashrate / 1000.0f << ";" << t.farm.solutions.accepted << ";"
-               << t.farm.solutions.rejected;
+    totalMhEth << fixed << setprecision(0) << t->farm.hashrate / 1000.0f << ";" << t->farm.solutions.accepted << ";"
+               << t->farm.solutions.rejected;
     totalMhDcr << "0;0;0";                           // DualMining not supported
-    invalidStats << t.farm.solutions.failed << ";0"; // Invalid + Pool switches
+    invalidStats << t->farm.solutions.failed << ";0"; // Invalid + Pool switches
     poolAddresses << connection->Host() << ':' << connection->Port();
     invalidStats << ";0;0"; // DualMining not supported
 
     int gpuIndex;
-    int numGpus = t.miners.size();
+    int numGpus = t->miners.size();
 
     for (gpuIndex = 0; gpuIndex < numGpus; gpuIndex++) {
-        detailedMhEth << fixed << setprecision(0) << t.miners.at(gpuIndex).hashrate / 1000.0f
+        detailedMhEth << fixed << setprecision(0) << t->miners.at(gpuIndex).hashrate / 1000.0f
                       << (((numGpus - 1) > gpuIndex) ? ";" : "");
         detailedMhDcr << "off" << (((numGpus - 1) > gpuIndex) ? ";" : ""); // DualMining not supported
-        tempAndFans << t.miners.at(gpuIndex).sensors.tempC << ";" << t.miners.at(gpuIndex).sensors.fanP
+        tempAndFans << t->miners.at(gpuIndex).sensors.tempC << ";" << t->miners.at(gpuIndex).sensors.fanP
                     << (((numGpus - 1) > gpuIndex) ? ";" : ""); // Fetching Temp and Fans
-        memTemps << t.miners.at(gpuIndex).sensors.memtempC
+        memTemps << t->miners.at(gpuIndex).sensors.memtempC
                  << (((numGpus - 1) > gpuIndex) ? ";" : ""); // Fetching Temp and Fans
     }
 
@@ -808,7 +902,17 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(const TelemetryType& _t, s
     DeviceDescriptor minerDescriptor = _miner->getDescriptor();
 
     jRes["_index"] = _index;
-    jRes["_mode"] = (minerDescriptor.subscriptionType == DeviceSubscriptionTypeEnum::Cuda ? "CUDA" : "OpenCL");
+    switch (minerDescriptor.subscriptionType) {
+    case DeviceSubscriptionTypeEnum::Cuda:
+        jRes["_mode"] = "CUDA";
+        break;
+    case DeviceSubscriptionTypeEnum::Cpu:
+        jRes["_mode"] = "CPU";
+        break;
+    default:
+        jRes["_mode"] = "OpenCL";
+        break;
+    }
 
     /* Hardware Info */
     Json::Value hwinfo;
@@ -822,6 +926,11 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(const TelemetryType& _t, s
     ostringstream ss;
     ss << minerDescriptor.boardName << " " << dev::getFormattedMemory((double)minerDescriptor.totalMemory);
     hwinfo["name"] = ss.str();
+    string pages = _miner->dagPageMode();
+    if (!pages.empty())
+        hwinfo["pages"] = pages;
+    if (_t.miners.at(_index).numaNode >= 0)
+        hwinfo["numa"] = _t.miners.at(_index).numaNode;
 
     /* Hardware Sensors*/
     Json::Value sensors = Json::Value(Json::arrayValue);
@@ -852,6 +961,29 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(const TelemetryType& _t, s
     /* Hash & Share infos */
     mininginfo["hashrate"] = toHex((uint32_t)_t.miners.at(_index).hashrate, HexPrefix::Add);
 
+    /* DAG generation, while queued or running */
+    for (auto const& build : Farm::f().dagScheduler().status())
+        if (build.miner == _index && build.state != DagBuildState::Idle) {
+            Json::Value daginfo;
+            daginfo["state"] = build.state == DagBuildState::Queued ? "queued" : "building";
+            daginfo["progress"] = unsigned(build.progress * 100);
+            daginfo["eta"] = unsigned(build.eta + 0.5f);
+            mininginfo["dag"] = daginfo;
+        }
+
+    /* Batch sizing decisions */
+    BatchStatus batch = _miner->batchController().status();
+    Json::Value batchinfo;
+    batchinfo["risk"] = batch.risk * 100;
+    batchinfo["min"] = batch.minTime;
+    batchinfo["max"] = batch.maxTime;
+    batchinfo["target"] = batch.target;
+    batchinfo["time"] = batch.batchTime;
+    batchinfo["jobinterval"] = batch.jobInterval;
+    batchinfo["multiple"] = batch.multiple;
+    batchinfo["tuned"] = batch.tuned;
+    mininginfo["batch"] = batchinfo;
+
     jRes["hardware"] = hwinfo;
     jRes["mining"] = mininginfo;
 
@@ -1053,11 +1185,82 @@ string ApiConnection::getHttpMinerStatDetail() {
     return _ret.str();
 }
 
+// Stalls detected by the watchdog, oldest first
+Json::Value ApiConnection::getStalls() {
+    Json::Value jRes = Json::Value(Json::arrayValue);
+    for (auto const& r : Farm::f().watchdog().history()) {
+        Json::Value stall;
+        stall["index"] = r.miner;
+        stall["time"] = Json::Int64(chrono::system_clock::to_time_t(r.start));
+        stall["duration"] = Json::UInt(r.seconds * 1000);
+        stall["action"] = Watchdog::actionName(r.action);
+        stall["recovered"] = r.recovered;
+        jRes.append(stall);
+    }
+    return jRes;
+}
+
+static Json::Value hashRateStats(HashRateSeries::Stats const& _stats, double _ewma) {
+    Json::Value jRes;
+    jRes["ewma"] = Json::UInt64(_ewma);
+    jRes["min"] = Json::UInt64(_stats.min);
+    jRes["max"] = Json::UInt64(_stats.max);
+    jRes["p5"] = Json::UInt64(_stats.p5);
+    jRes["p95"] = Json::UInt64(_stats.p95);
+    return jRes;
+}
+
+// Hashrate stats over the last _span seconds for the farm and each miner
+Json::Value ApiConnection::getHashRateStats(unsigned _span) {
+    Json::Value jRes;
+    Json::Value devices = Json::Value(Json::arrayValue);
+    vector<float> total;
+    double ewma = 0.0;
+    unsigned interval = 1;
+
+    for (shared_ptr<Miner> miner : Farm::f().getMiners()) {
+        auto const& series = miner->hashRateSeries();
+        auto samples = series.samples(_span, interval);
+        Json::Value device = hashRateStats(HashRateSeries::stats(samples), series.ewma());
+        device["index"] = miner->Index();
+        devices.append(device);
+        HashRateSeries::accumulate(total, samples);
+        ewma += series.ewma();
+    }
+
+    jRes["span"] = _span;
+    jRes["farm"] = hashRateStats(HashRateSeries::stats(total), ewma);
+    jRes["devices"] = devices;
+    return jRes;
+}
+
+// Hashrate samples over the last _span seconds for a miner or, if _index is null, the farm
+Json::Value ApiConnection::getHashRateSeries(Json::Value const& _index, unsigned _span) {
+    Json::Value jRes;
+    vector<float> total;
+    unsigned interval = 1;
+
+    for (shared_ptr<Miner> miner : Farm::f().getMiners())
+        if (_index.isNull() || miner->Index() == _index.asUInt())
+            HashRateSeries::accumulate(total, miner->hashRateSeries().samples(_span, interval));
+
+    Json::Value samples = Json::Value(Json::arrayValue);
+    for (float hr : total)
+        samples.append(isnan(hr) ? Json::Value::null : Json::Value(Json::UInt64(hr)));
+
+    // Samples end with the last completed second, or minute
+    jRes["index"] = _index;
+    jRes["interval"] = interval;
+    jRes["end"] = Json::UInt64(time(nullptr) / interval * interval);
+    jRes["samples"] = samples;
+    return jRes;
+}
+
 Json::Value ApiConnection::getMinerStatDetail() {
     const chrono::steady_clock::time_point now = chrono::steady_clock::now();
-    TelemetryType t = Farm::f().Telemetry();
+    auto t = Farm::f().Telemetry();
 
-    auto runningTime = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - t.start);
+    auto runningTime = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - t->start);
 
     // ostringstream version;
     Json::Value devices = Json::Value(Json::arrayValue);
@@ -1088,19 +1291,38 @@ Json::Value ApiConnection::getMinerStatDetail() {
     Json::Value mininginfo;
     Json::Value sharesinfo = Json::Value(Json::arrayValue);
 
-    mininginfo["hashrate"] = toHex(uint32_t(t.farm.hashrate), HexPrefix::Add);
+    mininginfo["hashrate"] = toHex(uint32_t(t->farm.hashrate), HexPrefix::Add);
     mininginfo["epoch"] = PoolManager::p().getCurrentEpoch();
     mininginfo["epoch_changes"] = PoolManager::p().getEpochChanges();
     mininginfo["difficulty"] = PoolManager::p().getPoolDifficulty();
 
-    sharesinfo.append(t.farm.solutions.accepted);
-    sharesinfo.append(t.farm.solutions.rejected);
-    sharesinfo.append(t.farm.solutions.failed);
-    auto solution_lastupdated = chrono::duration_cast<chrono::seconds>(now - t.farm.solutions.tstamp);
+    sharesinfo.append(t->farm.solutions.accepted);
+    sharesinfo.append(t->farm.solutions.rejected);
+    sharesinfo.append(t->farm.solutions.failed);
+    auto solution_lastupdated = chrono::duration_cast<chrono::seconds>(now - t->farm.solutions.tstamp);
     sharesinfo.append(uint64_t(solution_lastupdated.count())); // interval in seconds from last
                                                                // found share
     mininginfo["shares"] = sharesinfo;
 
+    /* Share verification */
+    Json::Value verifyinfo;
+    verifyinfo["queue"] = Farm::f().verifier().queueDepth();
+    verifyinfo["latency"] = Farm::f().verifier().latency();
+    mininginfo["verify"] = verifyinfo;
+
+    /* Hashrate per NUMA node */
+    auto nodes = t->nodeHashrates();
+    if (!nodes.empty()) {
+        Json::Value numainfo = Json::Value(Json::arrayValue);
+        for (auto& node : nodes) {
+            Json::Value nodeinfo;
+            nodeinfo["node"] = node.first;
+            nodeinfo["hashrate"] = toHex(uint32_t(node.second), HexPrefix::Add);
+            numainfo.append(nodeinfo);
+        }
+        mininginfo["numa"] = numainfo;
+    }
+
     /* Monitors Info */
     Json::Value monitorinfo;
     auto tstop = Farm::f().get_tstop();
@@ -1113,7 +1335,8 @@ Json::Value ApiConnection::getMinerStatDetail() {
 
     /* Devices related info */
     for (shared_ptr<Miner> miner : Farm::f().getMiners())
-        devices.append(getMinerStatDetailPerMiner(t, miner));
+        if (miner->Index() < t->miners.size()) // Not yet in the snapshot if just started
+            devices.append(getMinerStatDetailPerMiner(*t, miner));
 
     jRes["devices"] = devices;
 
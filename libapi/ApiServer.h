@@ -56,6 +56,9 @@ class ApiConnection {
 
     Json::Value getMinerStatDetail();
     Json::Value getMinerStatDetailPerMiner(const TelemetryType& _t, std::shared_ptr<Miner> _miner);
+    Json::Value getStalls();
+    Json::Value getHashRateStats(unsigned _span);
+    Json::Value getHashRateSeries(Json::Value const& _index, unsigned _span);
 
     std::string getHttpMinerMetrics();
     std::string getHttpMinerStatDetail();
@@ -14,6 +14,7 @@
 #include <libeth/Farm.h>
 
 #include "CLMiner.h"
+#include "CLProgramCache.h"
 #include "ethash.h"
 
 using namespace dev;
@@ -231,6 +232,7 @@ vector<cl::Device> getDevices(vector<cl::Platform> const& _platforms, unsigned _
 CLMiner::CLMiner(unsigned _index, DeviceDescriptor& _device) : Miner("cl-", _index) {
     m_deviceDescriptor = _device;
     m_block_multiple = 200000;
+    batchController().setLimits(BATCH_TIME_MIN, CL_TARGET_BATCH_TIME);
 }
 
 CLMiner::~CLMiner() {
@@ -253,60 +255,70 @@ void CLMiner::workLoop() {
     // Memory for zero-ing buffers. Cannot be static or const because crashes on macOS.
 
     uint64_t startNonce = 0;
+    unsigned next = 0; // Slot of the next kernel
 
-    // The work package currently processed by GPU.
-    WorkPackage current;
-    current.header = h256();
+    // The work package currently processed by GPU and the newest one published
+    uint32_t gen;
+    shared_ptr<const WorkPackage> current = make_shared<const WorkPackage>();
+    shared_ptr<const WorkPackage> w = work(gen);
 
-    if (!initDevice())
+    // A soft restart keeps the context, kernels and DAG
+    if (!m_deviceReady && !initDevice())
         return;
+    m_deviceReady = true;
 
     try {
         while (!shouldStop()) {
-            // Read results.
-            SearchResults results;
+            // Report the results of the kernel that last ran on this slot,
+            // the other slots keep the device busy meanwhile
+            SearchSlot& slot = m_slots[next];
+            if (slot.work)
+                collect(slot);
 
-            if (m_queue) {
-                // synchronize and read the results.
-                m_queue->enqueueReadBuffer(*m_searchBuffer, CL_TRUE, 0, sizeof(results), (void*)&results);
-                // clear the solution count, hash count, and abort flag
-                m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, 0, sizeof(zerox3), zerox3);
-            } else
-                results.count = 0;
+            // Pick up a newly published job, no locking unless there is one
+            if (workGeneration() != gen)
+                w = work(gen);
 
             // Wait for work or 3 seconds (whichever the first)
-            WorkPackage w = work();
-            if (!w) {
-                m_hung_miner.store(false);
-                unique_lock<mutex> l(miner_work_mutex);
-                m_new_work_signal.wait_for(l, chrono::seconds(3));
+            if (!*w) {
+                drain();
+                heartbeat(false);
+                waitWork(gen);
                 continue;
             }
 
-            if (current.header != w.header) {
-                if (current.epoch != w.epoch) {
-                    setEpoch(w);
-                    if (g_seqDAG)
-                        g_seqDAGMutex.lock();
-                    bool b = initEpoch();
-                    if (g_seqDAG)
-                        g_seqDAGMutex.unlock();
+            // The watchdog may ask to rebuild the device buffers of a stalled miner
+            bool reinit = reinitRequested();
+            if (current->header != w->header || reinit) {
+                // Kernels of the previous job were aborted, report what they found
+                drain();
+
+                if (m_dagEpoch != w->epoch || reinit) {
+                    m_dagEpoch = -1;
+                    setEpoch(*w);
+                    // Sweep the kernel settings on the first epoch, before its DAG is built
+                    if (m_deviceDescriptor.clAutotune) {
+                        m_deviceDescriptor.clAutotune = false;
+                        autotune();
+                    }
+                    bool b = buildEpoch();
                     if (!b)
                         break;
                     freeCache();
-                    w = work();
+                    m_dagEpoch = w->epoch;
+                    w = work(gen);
                 }
 
-                startNonce = w.startNonce;
-
-                // Update header constant buffer.
-                m_queue->enqueueWriteBuffer(*m_header, CL_FALSE, 0, w.header.size, w.header.data());
+                // Update header constant buffer. Blocking, the package may be
+                // replaced before the copy would otherwise take place.
+                m_queue->enqueueWriteBuffer(*m_header, CL_TRUE, 0, w->header.size, w->header.data());
 
-                // zero the result count
-                m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, offsetof(SearchResults, count), sizeof(zerox3),
-                                            zerox3);
+                // clear the solution count, hash count, and abort flag
+                for (auto& s : m_slots)
+                    m_queue->enqueueWriteBuffer(*s.buffer, CL_FALSE, 0, sizeof(zerox3), zerox3);
 
-                m_searchKernel.setArg(6, (uint64_t)(u64)((u256)w.boundary >> 192));
+                m_searchKernel.setArg(4, (uint64_t)(u64)((u256)w->boundary >> 192));
+                current = w;
 #ifdef DEV_BUILD
                 if (g_logOptions & LOG_SWITCH)
                     cnote << "Switch time: "
@@ -317,56 +329,221 @@ void CLMiner::workLoop() {
 #endif
             }
 
-            float hr = RetrieveHashRate();
-            if (hr > 1e7)
-                m_block_multiple = uint32_t(hr * CL_TARGET_BATCH_TIME / m_deviceDescriptor.clGroupSize);
+            m_block_multiple = batchController().multiple(m_block_multiple, m_deviceDescriptor.clGroupSize);
 
             uint32_t batch_blocks = m_deviceDescriptor.clGroupSize * m_block_multiple;
 
-            // Run the kernel.
-            m_searchKernel.setArg(5, startNonce);
-            m_hung_miner.store(false);
-            m_queue->enqueueNDRangeKernel(m_searchKernel, cl::NullRange, batch_blocks, m_deviceDescriptor.clGroupSize);
-
-            // Report results while the kernel is running.
-            if (results.count > c_maxSearchResults)
-                results.count = c_maxSearchResults;
-            for (uint32_t i = 0; i < results.count; i++) {
-                uint64_t nonce = current.startNonce + results.gid[i];
-                Farm::f().submitProof(Solution{nonce, h256(), current, chrono::steady_clock::now(), m_index});
-                ReportSolution(current.header, nonce);
+            // Take the nonces of the kernel, fails if the job was replaced
+            // meanwhile or its nonces are exhausted: wait for the next one
+            if (!nextNonces(*w, batch_blocks, startNonce)) {
+                drain();
+                heartbeat(false);
+                waitWork(gen);
+                continue;
             }
 
-            current = w; // kernel now processing newest work
-            current.startNonce = startNonce;
-            // Increase start nonce for following kernel execution.
-            startNonce += batch_blocks;
-            // Report hash count
-            updateHashRate(m_deviceDescriptor.clGroupSize, results.hashCount);
+            // Queue the kernel behind the one running, once its slot is cleared
+            vector<cl::Event> wait;
+            if (slot.ready())
+                wait.push_back(slot.ready);
+            m_searchKernel.setArg(0, *slot.buffer);
+            m_searchKernel.setArg(3, startNonce);
+            heartbeat();
+            m_queue->enqueueNDRangeKernel(m_searchKernel, cl::NullRange, batch_blocks, m_deviceDescriptor.clGroupSize,
+                                          wait.empty() ? nullptr : &wait, &slot.done);
+            m_queue->flush();
+            slot.ready = cl::Event();
+            slot.work = w;
+            slot.nonce = startNonce;
+            next = (next + 1) % CL_PIPELINE_DEPTH;
         }
 
-        if (m_queue)
+        if (m_queue) {
+            drain();
             m_queue->finish();
+            m_resultqueue->finish();
+        }
 
-        free_buffers();
-        m_abortMutex.unlock();
+        if (keepDevice() && m_dagEpoch >= 0) {
+            // Drop the results of the last kernels and the abort flag, the
+            // next workLoop() starts on the buffers as they are
+            for (auto& s : m_slots)
+                m_queue->enqueueWriteBuffer(*s.buffer, CL_TRUE, 0, sizeof(zerox3), zerox3);
+        } else {
+            m_deviceReady = false;
+            m_dagEpoch = -1;
+            free_buffers();
+            m_abortMutex.unlock();
+        }
     } catch (cl::Error const& _e) {
         string _what = ethCLErrorHelper("OpenCL Error", _e);
+        m_deviceReady = false;
+        m_dagEpoch = -1;
         free_buffers();
         m_abortMutex.unlock();
         throw runtime_error(_what);
     }
 }
 
+void CLMiner::collect(SearchSlot& _slot) {
+    // Mapped on its own queue, the in order search queue would make the map
+    // wait for the kernel queued behind this one too
+    vector<cl::Event> wait{_slot.done};
+    auto r = static_cast<SearchResults*>(m_resultqueue->enqueueMapBuffer(
+        *_slot.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, sizeof(SearchResults), &wait));
+
+    SearchResults results;
+    results.count = min(r->count, uint32_t(c_maxSearchResults));
+    results.hashCount = r->hashCount;
+    for (uint32_t i = 0; i < results.count; i++)
+        results.gid[i] = r->gid[i];
+
+    // clear the solution count, hash count, and abort flag
+    r->count = 0;
+    r->hashCount = 0;
+    r->abort = 0;
+    m_resultqueue->enqueueUnmapMemObject(*_slot.buffer, r, nullptr, &_slot.ready);
+    m_resultqueue->flush();
+
+    shared_ptr<const WorkPackage> w;
+    w.swap(_slot.work);
+    _slot.done = cl::Event();
+
+    for (uint32_t i = 0; i < results.count; i++) {
+        uint64_t nonce = _slot.nonce + results.gid[i];
+        Farm::f().submitProof(Solution{nonce, h256(), *w, chrono::steady_clock::now(), m_index});
+        ReportSolution(w->header, nonce);
+    }
+
+    // Report hash count
+    updateHashRate(m_deviceDescriptor.clGroupSize, results.hashCount);
+}
+
+void CLMiner::drain() {
+    for (auto& slot : m_slots)
+        if (slot.work)
+            collect(slot);
+}
+
 void CLMiner::kick_miner() {
     m_abortMutex.lock();
     // Memory for abort Cannot be static because crashes on macOS.
     if (m_abortqueue) {
         static uint32_t one = 1;
-        m_abortqueue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, offsetof(SearchResults, abort), sizeof(one), &one);
+        for (auto& slot : m_slots)
+            m_abortqueue->enqueueWriteBuffer(*slot.buffer, CL_FALSE, offsetof(SearchResults, abort), sizeof(one),
+                                             &one);
     }
     m_abortMutex.unlock();
-    m_new_work_signal.notify_one();
+    wakeWork();
+}
+
+// Sweeps work group size and split DAG, each at a range of batch sizes, on
+// the epoch just set. The DAG is left ungenerated: its content doesn't change
+// the access pattern, and a target of 0 finds nothing anyway.
+void CLMiner::autotune() {
+    cnote << "Tuning OpenCL kernel on epoch " << m_epochContext.epochNumber;
+    size_t maxGroupSize = m_device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    unsigned groupSize0 = m_deviceDescriptor.clGroupSize;
+    bool split0 = m_deviceDescriptor.clSplit;
+    CLProfile best;
+
+    m_tuning = true;
+    for (bool split : {false, true}) {
+        for (unsigned groupSize : {64U, 128U, 256U}) {
+            if (groupSize > maxGroupSize || shouldStop())
+                continue;
+            m_deviceDescriptor.clGroupSize = groupSize;
+            m_deviceDescriptor.clSplit = split;
+            if (!buildEpoch())
+                continue;
+            // A DAG too large for one buffer is split anyway, timed with the split ones
+            if (!split && m_dagParts > 1)
+                continue;
+            CLProfile p;
+            try {
+                p = tuneBatch();
+            } catch (cl::Error const& _e) {
+                cwarn << ethCLErrorHelper("Tuning failed", _e);
+                continue;
+            }
+            cextr << "Work group " << groupSize << (split ? ", split DAG" : "") << ": "
+                  << getFormattedHashes(p.rate) << " at " << p.multiple << " groups per batch, " << fixed
+                  << setprecision(3) << p.latency << " s";
+            if (p.rate > best.rate)
+                best = p;
+        }
+    }
+    m_tuning = false;
+
+    // initEpoch() paused the miner on the settings that failed
+    resume(MinerPauseEnum::PauseDueToInsufficientMemory);
+    resume(MinerPauseEnum::PauseDueToInitEpochError);
+
+    if (!best.rate) {
+        if (!shouldStop())
+            cwarn << "Tuning found no working kernel settings";
+        m_deviceDescriptor.clGroupSize = groupSize0;
+        m_deviceDescriptor.clSplit = split0;
+        return;
+    }
+    m_deviceDescriptor.clGroupSize = best.groupSize;
+    m_deviceDescriptor.clSplit = best.split;
+    m_block_multiple = best.multiple;
+    batchController().setTuned(best.multiple);
+    CLProfileStore::store(m_profileKey, best);
+    cnote << "Tuned: work group " << best.groupSize << ", " << best.multiple << " groups per batch"
+          << (best.split ? ", split DAG" : "") << ", " << getFormattedHashes(best.rate);
+}
+
+// Times CL_TUNE_BATCHES kernels of each batch size, doubling from
+// CL_TUNE_MULTIPLE_MIN work groups until a batch exceeds the longest batch
+// time. Returns the smallest batch within CL_TUNE_PLATEAU of the best rate.
+// The kernels count their hashes in a buffer of their own, a kick aborting
+// them would leave the count short.
+CLProfile CLMiner::tuneBatch() {
+    uint32_t groupSize = m_deviceDescriptor.clGroupSize;
+    vector<uint8_t> header(32, 0);
+    m_queue->enqueueWriteBuffer(*m_header, CL_TRUE, 0, header.size(), header.data());
+    cl::Buffer buffer(*m_context, CL_MEM_READ_WRITE, sizeof(SearchResults));
+    m_searchKernel.setArg(0, buffer);
+    m_searchKernel.setArg(4, uint64_t(0));
+
+    vector<CLProfile> runs;
+    for (uint64_t multiple = CL_TUNE_MULTIPLE_MIN; multiple * groupSize <= numeric_limits<uint32_t>::max();
+         multiple *= 2) {
+        if (shouldStop())
+            break;
+        uint32_t items = uint32_t(multiple * groupSize);
+        m_queue->enqueueWriteBuffer(buffer, CL_TRUE, 0, sizeof(zerox3), zerox3);
+        auto start = chrono::steady_clock::now();
+        for (unsigned i = 0; i < CL_TUNE_BATCHES; i++) {
+            m_searchKernel.setArg(3, uint64_t(i) * items);
+            m_queue->enqueueNDRangeKernel(m_searchKernel, cl::NullRange, items, groupSize);
+        }
+        SearchResults results;
+        m_queue->enqueueReadBuffer(buffer, CL_TRUE, 0, sizeof(results), &results);
+        float t = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+
+        CLProfile p;
+        p.groupSize = groupSize;
+        p.multiple = uint32_t(multiple);
+        p.split = m_dagParts > 1;
+        p.latency = t / CL_TUNE_BATCHES;
+        p.rate = t > 0.0f ? float(results.hashCount) * groupSize / t : 0.0f;
+        if (p.latency > CL_TARGET_BATCH_TIME && !runs.empty())
+            break;
+        runs.push_back(p);
+    }
+
+    CLProfile best;
+    for (auto const& p : runs)
+        if (p.rate > best.rate)
+            best = p;
+    for (auto const& p : runs)
+        if (p.rate >= best.rate * CL_TUNE_PLATEAU)
+            return p;
+    return best;
 }
 
 void CLMiner::enumDevices(minerMap& _DevicesCollection) {
@@ -547,6 +724,21 @@ bool CLMiner::initDevice() {
         }
     }
 
+    // Kernel settings --cl-autotune measured on this device and driver
+    cl::Platform platform(m_device.getInfo<CL_DEVICE_PLATFORM>());
+    m_profileKey =
+        CLProfileStore::key({m_deviceDescriptor.uniqueId, m_device.getInfo<CL_DEVICE_NAME>(),
+                             platform.getInfo<CL_PLATFORM_VERSION>(), m_device.getInfo<CL_DRIVER_VERSION>()});
+    CLProfile profile;
+    if (m_deviceDescriptor.clProfile && !m_deviceDescriptor.clAutotune && CLProfileStore::load(m_profileKey, profile)) {
+        m_deviceDescriptor.clGroupSize = profile.groupSize;
+        m_deviceDescriptor.clSplit = profile.split;
+        m_block_multiple = profile.multiple;
+        batchController().setTuned(profile.multiple);
+        cextr << "Using tuned profile: work group " << profile.groupSize << ", " << profile.multiple
+              << " groups per batch" << (profile.split ? ", split DAG" : "");
+    }
+
     ostringstream s;
     s << "Using Pci " << m_deviceDescriptor.uniqueId << ": " << m_deviceDescriptor.boardName;
 
@@ -561,6 +753,81 @@ bool CLMiner::initDevice() {
     return true;
 }
 
+// Generates the DAG on the device from the light cache
+void CLMiner::generateDag() {
+    m_dagKernel.setArg(1, *m_light);
+    m_dagKernel.setArg(2, (uint32_t)(m_epochContext.lightSize / 64));
+    m_dagKernel.setArg(3, m_dagItems);
+    for (unsigned i = 0; i < m_dagParts; i++)
+        m_dagKernel.setArg(4 + i, *m_dag[i]);
+
+    const uint32_t workItems = m_dagItems * 2; // GPU computes partial 512-bit DAG items.
+
+    uint32_t start, chunk = m_deviceDescriptor.clGroupSize * m_block_multiple;
+    if (chunk > workItems)
+        chunk = workItems;
+    for (start = 0; start <= workItems - chunk; start += chunk) {
+        m_dagKernel.setArg(0, start);
+        m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, chunk, m_deviceDescriptor.clGroupSize);
+        m_queue->finish();
+        reportDagProgress(float(start + chunk) / workItems);
+    }
+    if (start < workItems) {
+        uint32_t groupsLeft = workItems - start;
+        groupsLeft = (groupsLeft + m_deviceDescriptor.clGroupSize - 1) / m_deviceDescriptor.clGroupSize;
+        m_dagKernel.setArg(0, start);
+        m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, groupsLeft * m_deviceDescriptor.clGroupSize,
+                                      m_deviceDescriptor.clGroupSize);
+        m_queue->finish();
+    }
+}
+
+// Streams the DAG generated on the host, each part as soon as the host
+// threads are done with it. The writes don't block, the host generates the
+// next part meanwhile. False if the miner was stopped before the end.
+bool CLMiner::uploadDag(HostDag& _dag) {
+    const size_t itemSize = 128; // A DAG item is 1024 bits
+    const uint8_t* items = _dag.data();
+    int done = 0;
+    try {
+        while (done < int(m_dagItems)) {
+            int ready = _dag.wait(done, [this] { return shouldStop(); });
+            if (ready == done) {
+                m_queue->finish();
+                return false;
+            }
+            if (m_dagParts == 1)
+                m_queue->enqueueWriteBuffer(*m_dag[0], CL_FALSE, done * itemSize, (ready - done) * itemSize,
+                                            items + done * itemSize);
+            else {
+                // Every m_dagParts-th item goes to the same buffer
+                int parts = int(m_dagParts);
+                for (int part = 0; part < parts; part++) {
+                    int first = done + (part - done % parts + parts) % parts;
+                    if (first >= ready)
+                        continue;
+                    size_t count = (ready - first + parts - 1) / parts;
+                    m_queue->enqueueWriteBufferRect(*m_dag[part], CL_FALSE, {0, size_t(first / parts), 0},
+                                                    {0, 0, 0}, {itemSize, count, 1}, itemSize, 0,
+                                                    parts * itemSize, 0, items + first * itemSize);
+                }
+            }
+            m_queue->flush();
+            reportDagProgress(float(ready) / m_dagItems);
+            done = ready;
+        }
+        m_queue->finish();
+    } catch (...) {
+        // The writes queued read the host DAG, which may go once we return
+        try {
+            m_queue->finish();
+        } catch (...) {
+        }
+        throw;
+    }
+    return true;
+}
+
 bool CLMiner::initEpoch() {
     m_initialized = false;
     auto startInit = chrono::steady_clock::now();
@@ -575,6 +842,8 @@ bool CLMiner::initEpoch() {
                       // Eventually resume mining when changing coin or epoch (NiceHash)
     }
 
+    // Keeps kick_miner() off the queues and buffers while they are rebuilt
+    unique_lock<mutex> lock(m_abortMutex, defer_lock);
     try {
         char options[256] = {0};
         int computeCapability = 0;
@@ -586,42 +855,54 @@ bool CLMiner::initEpoch() {
             sprintf(options, "-cl-nv-maxrregcount=%d", maxregs);
         }
 
-        free_buffers();
+        lock.lock();
+        release_buffers();
         // create context
         m_context = new cl::Context(vector<cl::Device>(&m_device, &m_device + 1));
         // create new queue with default in order execution property
         m_queue = new cl::CommandQueue(*m_context, m_device);
         m_abortqueue = new cl::CommandQueue(*m_context, m_device);
+        m_resultqueue = new cl::CommandQueue(*m_context, m_device);
 
         m_dagItems = m_epochContext.dagNumItems;
 
-        bool dagOk = true;
         // create buffer for dag
         try {
             // Create mining buffers
-            m_searchBuffer = new cl::Buffer(*m_context, CL_MEM_WRITE_ONLY, sizeof(SearchResults));
+            // Results are read by mapping, keep them in host accessible memory
+            for (auto& slot : m_slots)
+                slot.buffer = new cl::Buffer(*m_context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                             sizeof(SearchResults));
             m_header = new cl::Buffer(*m_context, CL_MEM_READ_ONLY, 32);
             m_light = new cl::Buffer(*m_context, CL_MEM_READ_ONLY, m_epochContext.lightSize);
-            if (!m_deviceDescriptor.clSplit) {
+            // Interleave the DAG over as many buffers as the largest allocation
+            // the device allows requires, doubling again if the driver refuses
+            uint64_t maxAlloc = m_device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+            uint64_t itemSize = m_epochContext.dagSize / m_dagItems;
+            m_dagParts = m_deviceDescriptor.clSplit ? 2 : 1;
+            while (m_dagParts < CL_MAX_DAG_PARTS && (m_dagItems + m_dagParts - 1) / m_dagParts * itemSize > maxAlloc)
+                m_dagParts *= 2;
+            for (;;) {
                 try {
-                    m_dag[0] = new cl::Buffer(*m_context, CL_MEM_READ_ONLY, m_epochContext.dagSize);
-                    m_dag[1] = nullptr;
+                    for (unsigned i = 0; i < m_dagParts; i++)
+                        m_dag[i] = new cl::Buffer(*m_context, CL_MEM_READ_ONLY,
+                                                  (m_dagItems - i + m_dagParts - 1) / m_dagParts * itemSize);
+                    break;
                 } catch (cl::Error const&) {
-                    dagOk = false;
+                    for (auto& dag : m_dag) {
+                        delete dag;
+                        dag = nullptr;
+                    }
+                    if (m_dagParts == CL_MAX_DAG_PARTS)
+                        throw;
+                    m_dagParts *= 2;
                 }
-            } else
-                dagOk = false;
-
-            if (!dagOk) {
-                unsigned delta = (m_epochContext.dagNumItems & 1) ? 64 : 0;
-                m_dag[0] = new cl::Buffer(*m_context, CL_MEM_READ_ONLY, m_epochContext.dagSize / 2 + delta);
-                m_dag[1] = new cl::Buffer(*m_context, CL_MEM_READ_ONLY, m_epochContext.dagSize / 2 - delta);
             }
         } catch (cl::Error const& err) {
             if ((err.err() == CL_OUT_OF_RESOURCES) || (err.err() == CL_OUT_OF_HOST_MEMORY)) {
                 cwarn << ethCLErrorHelper("Creating DAG buffer failed", err);
                 pause(MinerPauseEnum::PauseDueToInitEpochError);
-                free_buffers();
+                release_buffers();
                 return false;
             } else
                 throw;
@@ -645,20 +926,56 @@ bool CLMiner::initEpoch() {
         addDefinition(code, "MAX_OUTPUTS", c_maxSearchResults);
         addDefinition(code, "PLATFORM", static_cast<unsigned>(m_deviceDescriptor.clPlatformType));
         addDefinition(code, "COMPUTE", computeCapability);
-        if (!dagOk)
-            addDefinition(code, "SPLIT_DAG", 1);
+        addDefinition(code, "DAG_PARTS", m_dagParts);
+
+        // Look for a binary of the very same program built before
+        cl::Program program;
+        string cacheKey;
+        bool cached = false;
+        if (CLProgramCache::enabled()) {
+            cl::Platform platform(m_device.getInfo<CL_DEVICE_PLATFORM>());
+            cacheKey = CLProgramCache::key(
+                {platform.getInfo<CL_PLATFORM_NAME>(), platform.getInfo<CL_PLATFORM_VERSION>(),
+                 m_device.getInfo<CL_DEVICE_NAME>(), m_device.getInfo<CL_DEVICE_VERSION>(),
+                 m_device.getInfo<CL_DRIVER_VERSION>()},
+                options, code);
+            vector<unsigned char> binary;
+            if (CLProgramCache::load(cacheKey, binary)) {
+                try {
+                    program = cl::Program(*m_context, vector<cl::Device>{m_device}, cl::Program::Binaries{binary});
+                    program.build({m_device}, options);
+                    cached = true;
+                    cextr << "Loaded cached OpenCL kernel";
+                } catch (cl::Error const& err) {
+                    cwarn << ethCLErrorHelper("Cached OpenCL kernel refused, rebuilding", err);
+                    CLProgramCache::invalidate(cacheKey);
+                }
+            }
+        }
 
         // create miner OpenCL program
-        cl::Program::Sources sources{{code.data(), code.size()}};
-        cl::Program program(*m_context, sources);
-        try {
-            program.build({m_device}, options);
-        } catch (cl::BuildError const& buildErr) {
-            ccrit << "OpenCL kernel build log:\n" << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device);
-            ccrit << "OpenCL kernel build error (" << buildErr.err() << "):\n" << buildErr.what();
-            pause(MinerPauseEnum::PauseDueToInitEpochError);
-            free_buffers();
-            return false;
+        if (!cached) {
+            cl::Program::Sources sources{{code.data(), code.size()}};
+            program = cl::Program(*m_context, sources);
+            try {
+                program.build({m_device}, options);
+            } catch (cl::BuildError const& buildErr) {
+                ccrit << "OpenCL kernel build log:\n" << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device);
+                ccrit << "OpenCL kernel build error (" << buildErr.err() << "):\n" << buildErr.what();
+                pause(MinerPauseEnum::PauseDueToInitEpochError);
+                release_buffers();
+                return false;
+            }
+
+            if (!cacheKey.empty()) {
+                try {
+                    auto binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+                    if (binaries.size() == 1 && !binaries[0].empty())
+                        CLProgramCache::store(cacheKey, binaries[0]);
+                } catch (cl::Error const& err) {
+                    cwarn << ethCLErrorHelper("Can't cache OpenCL kernel", err);
+                }
+            }
         }
 
         try {
@@ -668,58 +985,51 @@ bool CLMiner::initEpoch() {
         } catch (cl::Error const& err) {
             cwarn << ethCLErrorHelper("Creating opencl failed", err);
             pause(MinerPauseEnum::PauseDueToInitEpochError);
-            free_buffers();
+            release_buffers();
             return false;
         }
-        // create buffer for header
-
-        m_searchKernel.setArg(1, m_header[0]);
-        m_searchKernel.setArg(2, *m_dag[0]);
-        m_searchKernel.setArg(3, *m_dag[1]);
-        m_searchKernel.setArg(4, m_dagItems);
-
-        m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, 0, sizeof(zerox3), zerox3);
-
-        m_dagKernel.setArg(1, *m_light);
-        m_dagKernel.setArg(2, *m_dag[0]);
-        m_dagKernel.setArg(3, *m_dag[1]);
-        m_dagKernel.setArg(4, (uint32_t)(m_epochContext.lightSize / 64));
-
-        const uint32_t workItems = m_dagItems * 2; // GPU computes partial 512-bit DAG items.
-
-        uint32_t start, chunk = m_deviceDescriptor.clGroupSize * m_block_multiple;
-        if (chunk > workItems)
-            chunk = workItems;
-        for (start = 0; start <= workItems - chunk; start += chunk) {
-            m_dagKernel.setArg(0, start);
-            m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, chunk, m_deviceDescriptor.clGroupSize);
-            m_queue->finish();
-        }
-        if (start < workItems) {
-            uint32_t groupsLeft = workItems - start;
-            groupsLeft = (groupsLeft + m_deviceDescriptor.clGroupSize - 1) / m_deviceDescriptor.clGroupSize;
-            m_dagKernel.setArg(0, start);
-            m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, groupsLeft * m_deviceDescriptor.clGroupSize,
-                                          m_deviceDescriptor.clGroupSize);
-            m_queue->finish();
+        for (auto& slot : m_slots)
+            m_queue->enqueueWriteBuffer(*slot.buffer, CL_FALSE, 0, sizeof(zerox3), zerox3);
+
+        // Tuning times the search alone, on whatever the DAG buffers hold
+        if (!m_tuning) {
+            // Stream the DAG generated on the host, or generate it here
+            shared_ptr<HostDag> dag;
+            if (m_deviceDescriptor.clHostDag) {
+                // The host may take minutes, kicks must not wait for it meanwhile
+                lock.unlock();
+                bool uploaded = false;
+                if (!(dag = Farm::f().hostDags().get(m_epochContext.epochNumber)))
+                    cwarn << "Generating the DAG on the device instead";
+                else
+                    uploaded = uploadDag(*dag);
+                lock.lock();
+                if (dag && !uploaded) {
+                    release_buffers();
+                    return false;
+                }
+            }
+            if (!dag)
+                generateDag();
         }
 
         auto dagTime = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startInit);
 
-        m_searchKernel.setArg(0, *m_searchBuffer); // Supply output buffer to kernel.
-        m_searchKernel.setArg(1, *m_header);       // Supply header buffer to kernel.
-        m_searchKernel.setArg(2, *m_dag[0]);       // Supply DAG buffer to kernel.
-        m_searchKernel.setArg(3, *m_dag[1]);       // Supply DAG buffer to kernel.
-        m_searchKernel.setArg(4, m_dagItems);
+        m_searchKernel.setArg(1, *m_header); // Supply header buffer to kernel, the workLoop() sets the output.
+        m_searchKernel.setArg(2, m_dagItems);
+        for (unsigned i = 0; i < m_dagParts; i++)
+            m_searchKernel.setArg(5 + i, *m_dag[i]); // Supply DAG buffers to kernel.
 
-        ReportDAGDone(m_epochContext.dagSize, uint32_t(dagTime.count()), dagOk);
+        if (!m_tuning)
+            ReportDAGDone(m_epochContext.dagSize, uint32_t(dagTime.count()), m_dagParts);
     } catch (cl::Error const& err) {
         ccrit << ethCLErrorHelper("OpenCL init failed", err);
         pause(MinerPauseEnum::PauseDueToInitEpochError);
-        free_buffers();
+        if (!lock.owns_lock())
+            lock.lock();
+        release_buffers();
         return false;
     }
     m_initialized = true;
-    m_abortMutex.unlock();
     return true;
 }
@@ -14,8 +14,11 @@
 
 #include <libdev/Worker.h>
 #include <libeth/EthashAux.h>
+#include <libeth/HostDag.h>
 #include <libeth/Miner.h>
 
+#include "CLProfileStore.h"
+
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -42,7 +45,12 @@
 #define CL_DEVICE_COMPUTE_CAPABILITY_MINOR_NV 0x4001
 #endif
 
-#define CL_TARGET_BATCH_TIME 0.3F // seconds
+#define CL_TARGET_BATCH_TIME 0.3F // seconds, longest batch by default
+#define CL_PIPELINE_DEPTH 2       // Search kernels queued at once, each with its own results buffer
+#define CL_MAX_DAG_PARTS 8        // Buffers the DAG may be split in, a power of 2
+#define CL_TUNE_MULTIPLE_MIN 256  // Work groups of the smallest batch --cl-autotune times
+#define CL_TUNE_BATCHES 4         // Batches timed per setting
+#define CL_TUNE_PLATEAU 0.97F     // Share of the best rate a smaller batch must reach to be preferred
 
 namespace dev {
 namespace eth {
@@ -59,8 +67,27 @@ class CLMiner : public Miner {
     void kick_miner() override;
 
   private:
+    /// One stage of the search pipeline. A kernel writes its results into
+    /// the slot's buffer, which lives in host accessible memory and is
+    /// mapped once the kernel completes, while the next slot's kernel runs.
+    struct SearchSlot {
+        cl::Buffer* buffer = nullptr;
+        cl::Event done;                          // Kernel completion
+        cl::Event ready;                         // Results cleared, the next kernel waits on it
+        std::shared_ptr<const WorkPackage> work; // Job of the kernel in flight, null if none
+        uint64_t nonce = 0;                      // First nonce of the kernel in flight
+    };
+
     void workLoop() override;
     bool initEpoch();
+    void generateDag();
+    bool uploadDag(HostDag& _dag);
+
+    void collect(SearchSlot& _slot);
+    void drain();
+
+    void autotune();
+    CLProfile tuneBatch();
 
     cl::Kernel m_searchKernel;
     cl::Kernel m_dagKernel;
@@ -69,20 +96,25 @@ class CLMiner : public Miner {
     cl::Context* m_context = nullptr;
     cl::CommandQueue* m_queue = nullptr;
     cl::CommandQueue* m_abortqueue = nullptr;
-    cl::Buffer* m_dag[2] = {nullptr, nullptr};
+    cl::CommandQueue* m_resultqueue = nullptr;
+    cl::Buffer* m_dag[CL_MAX_DAG_PARTS] = {};
     cl::Buffer* m_light = nullptr;
     cl::Buffer* m_header = nullptr;
-    cl::Buffer* m_searchBuffer = nullptr;
+    SearchSlot m_slots[CL_PIPELINE_DEPTH];
 
+    // Returns with m_abortMutex held
     void free_buffers() {
         m_abortMutex.lock();
-        if (m_dag[0]) {
-            delete m_dag[0];
-            m_dag[0] = nullptr;
-        }
-        if (m_dag[1]) {
-            delete m_dag[1];
-            m_dag[1] = nullptr;
+        release_buffers();
+    }
+
+    // Called with m_abortMutex held
+    void release_buffers() {
+        for (auto& dag : m_dag) {
+            if (dag) {
+                delete dag;
+                dag = nullptr;
+            }
         }
         if (m_light) {
             delete m_light;
@@ -92,9 +124,14 @@ class CLMiner : public Miner {
             delete m_header;
             m_header = nullptr;
         }
-        if (m_searchBuffer) {
-            delete m_searchBuffer;
-            m_searchBuffer = nullptr;
+        for (auto& slot : m_slots) {
+            slot.work.reset();
+            slot.done = cl::Event();
+            slot.ready = cl::Event();
+            if (slot.buffer) {
+                delete slot.buffer;
+                slot.buffer = nullptr;
+            }
         }
         if (m_queue) {
             delete m_queue;
@@ -104,6 +141,10 @@ class CLMiner : public Miner {
             delete m_abortqueue;
             m_abortqueue = nullptr;
         }
+        if (m_resultqueue) {
+            delete m_resultqueue;
+            m_resultqueue = nullptr;
+        }
         if (m_context) {
             delete m_context;
             m_context = nullptr;
@@ -111,6 +152,9 @@ class CLMiner : public Miner {
     }
 
     unsigned m_dagItems = 0;
+    unsigned m_dagParts = 1; // DAG buffers, item i is in m_dag[i % m_dagParts]
+    bool m_tuning = false;    // initEpoch() leaves the DAG ungenerated
+    std::string m_profileKey; // Device and driver the kernel settings are stored for
     std::mutex m_abortMutex;
 };
 
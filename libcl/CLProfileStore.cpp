@@ -0,0 +1,124 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <fstream>
+#include <limits>
+
+#include <boost/filesystem.hpp>
+
+#include <ethash/keccak.hpp>
+
+#include <libdev/CommonData.h>
+#include <libdev/Log.h>
+
+#include "CLProfileStore.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+static const string c_magic = "etcclprofile";
+
+mutex CLProfileStore::s_mutex;
+string CLProfileStore::s_dir;
+
+void CLProfileStore::setDir(string const& _dir) {
+    lock_guard<mutex> l(s_mutex);
+    s_dir = _dir;
+}
+
+bool CLProfileStore::enabled() {
+    lock_guard<mutex> l(s_mutex);
+    return !s_dir.empty();
+}
+
+string CLProfileStore::key(vector<string> const& _identity) {
+    string key;
+    for (auto const& s : _identity)
+        key += s + '\n';
+    auto h = ethash::keccak256(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+    return toHex(h.bytes);
+}
+
+// The file is plain text, one "name value" pair per line after the header
+bool CLProfileStore::load(string const& _key, CLProfile& _profile) {
+    if (!enabled())
+        return false;
+    ifstream f(path(_key));
+    if (!f)
+        return false;
+
+    string magic, key;
+    unsigned version = 0;
+    f >> magic >> version >> key;
+    if (!f || magic != c_magic || version != CL_PROFILE_VERSION || key != _key)
+        return false;
+
+    CLProfile p;
+    string name;
+    while (f >> name) {
+        if (name == "group")
+            f >> p.groupSize;
+        else if (name == "multiple")
+            f >> p.multiple;
+        else if (name == "split")
+            f >> p.split;
+        else if (name == "rate")
+            f >> p.rate;
+        else if (name == "latency")
+            f >> p.latency;
+        else
+            f.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    if (f.bad() || (p.groupSize != 64 && p.groupSize != 128 && p.groupSize != 256) || !p.multiple)
+        return false;
+    _profile = p;
+    return true;
+}
+
+void CLProfileStore::store(string const& _key, CLProfile const& _profile) {
+    if (!enabled())
+        return;
+    namespace fs = boost::filesystem;
+    fs::path target(path(_key));
+    boost::system::error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+
+    // Written aside then renamed, so concurrent miners never see a partial file
+    fs::path tmp = target.parent_path() / fs::unique_path("%%%%%%%%.tmp");
+    {
+        ofstream f(tmp.string(), ios::trunc);
+        f << c_magic << ' ' << CL_PROFILE_VERSION << ' ' << _key << '\n'
+          << "group " << _profile.groupSize << '\n'
+          << "multiple " << _profile.multiple << '\n'
+          << "split " << _profile.split << '\n'
+          << "rate " << _profile.rate << '\n'
+          << "latency " << _profile.latency << '\n';
+        if (!f) {
+            cwarn << "Can't write OpenCL profile " << tmp.string();
+            f.close();
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    fs::rename(tmp, target, ec);
+    if (ec) {
+        cwarn << "Can't write OpenCL profile " << target.string() << " : " << ec.message();
+        fs::remove(tmp, ec);
+    }
+}
+
+string CLProfileStore::path(string const& _key) {
+    lock_guard<mutex> l(s_mutex);
+    return s_dir + "/" + _key.substr(0, 32) + ".clprofile";
+}
+
+} // namespace eth
+} // namespace dev
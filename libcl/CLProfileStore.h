@@ -0,0 +1,51 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CL_PROFILE_VERSION 1 // Bumped when the file layout or the tuning changes
+
+namespace dev {
+namespace eth {
+
+struct CLProfile {
+    unsigned groupSize = 0; // Work group size
+    unsigned multiple = 0;  // Work groups per batch
+    bool split = false;     // DAG in two buffers
+    float rate = 0.0f;      // Hashes per second measured
+    float latency = 0.0f;   // Seconds per batch measured
+};
+
+/// Keeps the best kernel settings --cl-autotune found for each device, so
+/// later runs start with them. A profile is only valid for the device and
+/// the driver it was measured with, the key names both.
+class CLProfileStore {
+  public:
+    /// Empty disables the store
+    static void setDir(std::string const& _dir);
+    static bool enabled();
+
+    static std::string key(std::vector<std::string> const& _identity);
+
+    static bool load(std::string const& _key, CLProfile& _profile);
+    static void store(std::string const& _key, CLProfile const& _profile);
+
+  private:
+    static std::string path(std::string const& _key);
+
+    static std::mutex s_mutex;
+    static std::string s_dir;
+};
+
+} // namespace eth
+} // namespace dev
@@ -0,0 +1,121 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <cstring>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include <ethash/keccak.hpp>
+
+#include <libdev/CommonData.h>
+#include <libdev/Log.h>
+
+#include "CLProgramCache.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+static const char c_magic[8] = {'e', 't', 'c', 'c', 'l', 'b', 'i', 'n'};
+
+mutex CLProgramCache::s_mutex;
+string CLProgramCache::s_dir;
+
+void CLProgramCache::setDir(string const& _dir) {
+    lock_guard<mutex> l(s_mutex);
+    s_dir = _dir;
+}
+
+bool CLProgramCache::enabled() {
+    lock_guard<mutex> l(s_mutex);
+    return !s_dir.empty();
+}
+
+string CLProgramCache::key(vector<string> const& _identity, string const& _options, string const& _source) {
+    string key;
+    for (auto const& s : _identity)
+        key += s + '\n';
+    key += _options + '\n';
+    auto h = ethash::keccak256(reinterpret_cast<const uint8_t*>(_source.data()), _source.size());
+    key += toHex(h.bytes);
+    return key;
+}
+
+bool CLProgramCache::load(string const& _key, vector<unsigned char>& _binary) {
+    ifstream f(path(_key), ios::binary);
+    if (!f)
+        return false;
+
+    char magic[sizeof(c_magic)];
+    uint32_t version = 0, keySize = 0;
+    f.read(magic, sizeof(magic));
+    f.read(reinterpret_cast<char*>(&version), sizeof(version));
+    f.read(reinterpret_cast<char*>(&keySize), sizeof(keySize));
+    if (!f || memcmp(magic, c_magic, sizeof(c_magic)) || version != CL_CACHE_VERSION || keySize != _key.size())
+        return false;
+
+    string key(keySize, '\0');
+    uint64_t binarySize = 0;
+    f.read(&key[0], keySize);
+    f.read(reinterpret_cast<char*>(&binarySize), sizeof(binarySize));
+    if (!f || key != _key || !binarySize || binarySize > CL_CACHE_MAX_BINARY)
+        return false;
+
+    _binary.resize(binarySize);
+    f.read(reinterpret_cast<char*>(_binary.data()), binarySize);
+    return bool(f);
+}
+
+void CLProgramCache::store(string const& _key, vector<unsigned char> const& _binary) {
+    namespace fs = boost::filesystem;
+    fs::path target(path(_key));
+    boost::system::error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+
+    // Written aside then renamed, so concurrent miners never see a partial file
+    fs::path tmp = target.parent_path() / fs::unique_path("%%%%%%%%.tmp");
+    {
+        ofstream f(tmp.string(), ios::binary | ios::trunc);
+        uint32_t version = CL_CACHE_VERSION, keySize = uint32_t(_key.size());
+        uint64_t binarySize = _binary.size();
+        f.write(c_magic, sizeof(c_magic));
+        f.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        f.write(reinterpret_cast<const char*>(&keySize), sizeof(keySize));
+        f.write(_key.data(), keySize);
+        f.write(reinterpret_cast<const char*>(&binarySize), sizeof(binarySize));
+        f.write(reinterpret_cast<const char*>(_binary.data()), binarySize);
+        if (!f) {
+            cwarn << "Can't write OpenCL kernel cache " << tmp.string();
+            f.close();
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    fs::rename(tmp, target, ec);
+    if (ec) {
+        cwarn << "Can't write OpenCL kernel cache " << target.string() << " : " << ec.message();
+        fs::remove(tmp, ec);
+    }
+}
+
+void CLProgramCache::invalidate(string const& _key) {
+    boost::system::error_code ec;
+    boost::filesystem::remove(path(_key), ec);
+}
+
+string CLProgramCache::path(string const& _key) {
+    auto h = ethash::keccak256(reinterpret_cast<const uint8_t*>(_key.data()), _key.size());
+    lock_guard<mutex> l(s_mutex);
+    return s_dir + "/" + toHex(h.bytes).substr(0, 32) + ".clbin";
+}
+
+} // namespace eth
+} // namespace dev
@@ -0,0 +1,50 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CL_CACHE_VERSION 1            // Bumped when the file layout changes
+#define CL_CACHE_MAX_BINARY (1 << 28) // bytes, larger entries are taken as corrupt
+
+namespace dev {
+namespace eth {
+
+/// Keeps compiled OpenCL programs on disk so that epoch changes and restarts
+/// don't rebuild the kernel. Entries are named after the keccak of everything
+/// the binary depends on: platform, driver and device identity, the build
+/// options and the patched source, which carries the defines. Each file
+/// repeats its key, so a mismatch or a truncated file is a miss.
+class CLProgramCache {
+  public:
+    /// Empty disables the cache
+    static void setDir(std::string const& _dir);
+    static bool enabled();
+
+    static std::string key(std::vector<std::string> const& _identity, std::string const& _options,
+                           std::string const& _source);
+
+    static bool load(std::string const& _key, std::vector<unsigned char>& _binary);
+    static void store(std::string const& _key, std::vector<unsigned char> const& _binary);
+
+    /// Drops an entry the driver refused
+    static void invalidate(std::string const& _key);
+
+  private:
+    static std::string path(std::string const& _key);
+
+    static std::mutex s_mutex;
+    static std::string s_dir;
+};
+
+} // namespace eth
+} // namespace dev
@@ -241,15 +241,34 @@ typedef union
     uint uints[16];
 } compute_hash_share;
 
-#ifdef SPLIT_DAG
+// The DAG is in DAG_PARTS buffers of a device allocation each, item i being
+// item i / DAG_PARTS of buffer i % DAG_PARTS
+#if DAG_PARTS == 1
+#define DAG_PARAMS(T) T _g_dag0
+#define DAG_ARRAY(T) T _g_dags[1] = {_g_dag0}
+#elif DAG_PARTS == 2
+#define DAG_PARAMS(T) T _g_dag0, T _g_dag1
+#define DAG_ARRAY(T) T _g_dags[2] = {_g_dag0, _g_dag1}
+#elif DAG_PARTS == 4
+#define DAG_PARAMS(T) T _g_dag0, T _g_dag1, T _g_dag2, T _g_dag3
+#define DAG_ARRAY(T) T _g_dags[4] = {_g_dag0, _g_dag1, _g_dag2, _g_dag3}
+#elif DAG_PARTS == 8
+#define DAG_PARAMS(T) T _g_dag0, T _g_dag1, T _g_dag2, T _g_dag3, T _g_dag4, T _g_dag5, T _g_dag6, T _g_dag7
+#define DAG_ARRAY(T) \
+    T _g_dags[8] = {_g_dag0, _g_dag1, _g_dag2, _g_dag3, _g_dag4, _g_dag5, _g_dag6, _g_dag7}
+#else
+#error DAG_PARTS must be 1, 2, 4 or 8
+#endif
+
+#if DAG_PARTS > 1
 #define MIX(x)                                                                       \
     do                                                                               \
     {                                                                                \
         buffer[get_local_id(0)] = fnv(init0 ^ (a + x), ((uint*)&mix)[x]) % dag_size; \
         uint idx = buffer[lane_idx];                                                 \
         __global hash128_t const* g_dag =                                            \
-            (__global hash128_t const*)_g_dag2[idx & 1];                             \
-        mix = fnv(mix, g_dag[idx >> 1].uint8s[thread_id]);                           \
+            (__global hash128_t const*)_g_dags[idx % DAG_PARTS];                     \
+        mix = fnv(mix, g_dag[idx / DAG_PARTS].uint8s[thread_id]);                    \
         mem_fence(CLK_LOCAL_MEM_FENCE);                                              \
     } while (0)
 #else
@@ -274,9 +293,8 @@ struct SearchResults
 };
 
 __attribute__((reqd_work_group_size(WORKSIZE, 1, 1))) __kernel void search(
-    __global struct SearchResults* g_output, __constant uint2 const* g_header,
-    __global ulong8 const* _g_dag0, __global ulong8 const* _g_dag1, uint dag_size,
-    ulong start_nonce, ulong target)
+    __global struct SearchResults* g_output, __constant uint2 const* g_header, uint dag_size,
+    ulong start_nonce, ulong target, DAG_PARAMS(__global ulong8 const*))
 {
     if (g_output->abort)
         return;
@@ -284,8 +302,8 @@ __attribute__((reqd_work_group_size(WORKSIZE, 1, 1))) __kernel void search(
     const uint thread_id = get_local_id(0) % 4;
     const uint hash_id = get_local_id(0) / 4;
     const uint gid = get_global_id(0);
-#ifdef SPLIT_DAG
-    __global const ulong8* _g_dag2[2] = {_g_dag0, _g_dag1};
+#if DAG_PARTS > 1
+    DAG_ARRAY(__global const ulong8*);
 #endif
 
     __local compute_hash_share sharebuf[WORKSIZE / 4];
@@ -427,8 +445,8 @@ static void SHA3_512(uint2* s)
         s[i] = st[i];
 }
 
-__kernel void GenerateDAG(uint start, __global const uint16* _Cache, __global uint16* _DAG0,
-    __global uint16* _DAG1, uint light_size)
+__kernel void GenerateDAG(
+    uint start, __global const uint16* _Cache, uint light_size, uint dag_size, DAG_PARAMS(__global uint16*))
 {
     __global const Node* Cache = (__global const Node*)_Cache;
     const uint gid = get_global_id(0);
@@ -469,16 +487,17 @@ __kernel void GenerateDAG(uint start, __global const uint16* _Cache, __global ui
     SHA3_512(DAGNode.qwords);
 
     __global Node* DAG;
-#ifdef SPLIT_DAG
-    if (NodeIdx & 2)
-        DAG = (__global Node*)_DAG1;
-    else
-        DAG = (__global Node*)_DAG0;
-    NodeIdx &= ~2;
-    // if (NodeIdx < DAG_SIZE)
-    DAG[(NodeIdx / 2) | (NodeIdx & 1)] = DAGNode;
+#if DAG_PARTS > 1
+    // Both halves of an item go to the same buffer
+    DAG_ARRAY(__global uint16*);
+    uint item = NodeIdx / 2;
+    DAG = (__global Node*)_g_dags[item % DAG_PARTS];
+    // The last work group runs past the end
+    if (item < dag_size)
+        DAG[(item / DAG_PARTS) * 2 + (NodeIdx & 1)] = DAGNode;
 #else
-    DAG = (__global Node *) _DAG0;
-    DAG[NodeIdx] = DAGNode; 
+    DAG = (__global Node *) _g_dag0;
+    if (NodeIdx / 2 < dag_size)
+        DAG[NodeIdx] = DAGNode;
 #endif
 }
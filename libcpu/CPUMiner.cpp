@@ -0,0 +1,308 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include <ethash/ethash.hpp>
+#include <libeth/Farm.h>
+
+#include "CPUMiner.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace {
+uint64_t getTotalPhysMemory() {
+#if defined(__linux__)
+    struct sysinfo info;
+    if (sysinfo(&info) != 0)
+        return 0;
+    return uint64_t(info.totalram) * info.mem_unit;
+#else
+    MEMORYSTATUSEX memInfo;
+    memInfo.dwLength = sizeof(MEMORYSTATUSEX);
+    if (!GlobalMemoryStatusEx(&memInfo))
+        return 0;
+    return memInfo.ullTotalPhys;
+#endif
+}
+
+string getCpuModelName() {
+#if defined(__linux__)
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line))
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t pos = line.find(':');
+            if (pos != string::npos && pos + 2 < line.size())
+                return line.substr(pos + 2);
+        }
+#endif
+    return "CPU";
+}
+
+#if !defined(__linux__)
+// Affinity of the main thread, never pinned, restored by unbindThread(). The
+// process mask can't be used once threads run in several processor groups.
+GROUP_AFFINITY g_unbound = {};
+#endif
+} // namespace
+
+CPUMiner::CPUMiner(unsigned _index, DeviceDescriptor& _device) : Miner("cp-", _index) {
+    m_deviceDescriptor = _device;
+    m_block_multiple = CP_BATCH_NONCES;
+#if !defined(__linux__)
+    if (!g_unbound.Mask)
+        GetThreadGroupAffinity(GetCurrentThread(), &g_unbound);
+#endif
+}
+
+CPUMiner::~CPUMiner() {
+    stopWorking();
+    kick_miner();
+}
+
+unsigned CPUMiner::getNumDevices() {
+#if defined(__linux__)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? unsigned(cpus) : 1;
+#else
+    // Of all processor groups, GetSystemInfo() counts the calling thread's only
+    DWORD cpus = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    return cpus > 0 ? unsigned(cpus) : 1;
+#endif
+}
+
+bool CPUMiner::initDevice() {
+    cextr << "Using CPU " << m_deviceDescriptor.cpCpuNumber << ": " << m_deviceDescriptor.boardName
+          << " Memory : " << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory);
+    return true;
+}
+
+// Pins the mining thread to its own core. Done on every workLoop() run,
+// whether the Worker reuses its thread, as on soft restarts, or not.
+void CPUMiner::bindThread() {
+    unsigned cpu = m_deviceDescriptor.cpCpuNumber;
+#if defined(__linux__)
+    // Sized for the core, cpu_set_t holds CPU_SETSIZE of them only
+    cpu_set_t* cpuset = CPU_ALLOC(cpu + 1);
+    size_t size = CPU_ALLOC_SIZE(cpu + 1);
+    if (!cpuset) {
+        cwarn << "Could not set affinity of CPU miner " << m_index << " : out of memory";
+        return;
+    }
+    CPU_ZERO_S(size, cpuset);
+    CPU_SET_S(cpu, size, cpuset);
+    if (sched_setaffinity(0, size, cpuset) != 0)
+        cwarn << "Could not set affinity of CPU miner " << m_index << " : " << strerror(errno);
+    CPU_FREE(cpuset);
+#else
+    // Cores are numbered across the processor groups, of 64 cores at most
+    GROUP_AFFINITY affinity = {};
+    WORD groups = GetActiveProcessorGroupCount();
+    while (affinity.Group < groups && cpu >= GetActiveProcessorCount(affinity.Group))
+        cpu -= GetActiveProcessorCount(affinity.Group++);
+    if (affinity.Group == groups) {
+        cwarn << "Could not set affinity of CPU miner " << m_index << " : no core "
+              << m_deviceDescriptor.cpCpuNumber;
+        return;
+    }
+    affinity.Mask = KAFFINITY(1) << cpu;
+    if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr))
+        cwarn << "Could not set affinity of CPU miner " << m_index << " : error " << GetLastError();
+#endif
+}
+
+// Lets the mining thread, and the threads it starts, run on every core the
+// process may use
+void CPUMiner::unbindThread() {
+#if defined(__linux__)
+    // The main thread is never pinned, its mask is the process one
+    cpu_set_t cpuset;
+    if (sched_getaffinity(getpid(), sizeof(cpuset), &cpuset) != 0 ||
+        sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0)
+        cwarn << "Could not reset affinity of CPU miner " << m_index << " : " << strerror(errno);
+#else
+    if (!g_unbound.Mask || !SetThreadGroupAffinity(GetCurrentThread(), &g_unbound, nullptr))
+        cwarn << "Could not reset affinity of CPU miner " << m_index << " : error " << GetLastError();
+#endif
+}
+
+bool CPUMiner::initEpoch() {
+    m_initialized = false;
+    auto startInit = chrono::steady_clock::now();
+    uint64_t RequiredMemory = m_epochContext.dagSize + m_epochContext.lightSize;
+
+    if (m_deviceDescriptor.totalMemory < RequiredMemory) {
+        ReportGPUNoMemoryAndPause("host", RequiredMemory, m_deviceDescriptor.totalMemory);
+        return false;
+    }
+
+    // All CPU miners hash against the same global full context. The first
+    // miner to get here generates the whole dataset using every core while
+    // the others wait for it. The generating threads inherit the affinity of
+    // this one, so it is pinned again only once the dataset is built.
+    m_dagProgress = 0;
+    unbindThread();
+    m_context = ethash_get_global_epoch_context_full_generated(m_epochContext.epochNumber, 0, onDagProgress, this);
+    bindThread();
+    if (!m_context) {
+        if (shouldStop())
+            return false;
+        ReportGPUNoMemoryAndPause("host", RequiredMemory, m_deviceDescriptor.totalMemory);
+        return false;
+    }
+
+    // On NUMA hosts hash against a copy of the DAG local to the node of this
+    // core. The first miner of each node makes the copy.
+    m_nodeContext.reset();
+    int node = m_deviceDescriptor.cpNumaNode;
+    if (m_deviceDescriptor.cpNumaReplicate && node >= 0 && CPUNuma::nodeCount() > 1) {
+        if (m_deviceDescriptor.totalMemory < RequiredMemory * (CPUNuma::nodeCount() + 1))
+            cwarn << "Not enough memory to copy the DAG to NUMA node " << node << ", using the shared one";
+        else if (!(m_nodeContext = CPUNuma::getNodeContext(*m_context, m_epochContext.epochNumber, node)))
+            cwarn << "Could not copy the DAG to NUMA node " << node << ", using the shared one";
+        else
+            m_context = m_nodeContext.get();
+    }
+
+    // Release the pause flag if any
+    resume(MinerPauseEnum::PauseDueToInsufficientMemory);
+    resume(MinerPauseEnum::PauseDueToInitEpochError);
+
+    m_dagPageMode = ethash::page_mode_name(ethash::get_page_mode(*m_context));
+
+    cextr << dev::getFormattedMemory(float(m_epochContext.dagSize)) << " of DAG data allocated in " << fixed
+          << setprecision(1)
+          << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startInit).count() / 1000.0f
+          << " seconds on " << m_dagPageMode.load() << " pages"
+          << (m_nodeContext ? " of NUMA node " + to_string(node) : string());
+
+    m_initialized = true;
+    return true;
+}
+
+bool CPUMiner::onDagProgress(int _done, int _total, void* _miner) {
+    CPUMiner* miner = static_cast<CPUMiner*>(_miner);
+    int percent = int(int64_t(_done) * 100 / _total);
+    miner->reportDagProgress(float(_done) / _total);
+    if (percent / 10 > miner->m_dagProgress / 10) {
+        miner->m_dagProgress = percent;
+        cextr << "Generating DAG " << percent << "%";
+    }
+    return !miner->shouldStop();
+}
+
+void CPUMiner::workLoop() {
+    uint32_t gen;
+
+    // A soft restart keeps the device and its DAG, the thread is bound again
+    bindThread();
+    if (!m_deviceReady && !initDevice())
+        return;
+    m_deviceReady = true;
+
+    while (!shouldStop()) {
+        // Wait for work or 3 seconds (whichever the first)
+        const shared_ptr<const WorkPackage> w = work(gen);
+        if (!*w) {
+            heartbeat(false);
+            waitWork(gen);
+            continue;
+        }
+
+        // Epoch change or reinit requested by the watchdog ?
+        if (m_dagEpoch != w->epoch || reinitRequested()) {
+            m_dagEpoch = -1;
+            setEpoch(*w);
+            bool b = buildEpoch();
+            freeCache();
+            if (!b)
+                break;
+
+            // As DAG allocation takes a while we need to
+            // ensure we're on latest job, not on the one
+            // which triggered the epoch change
+            m_dagEpoch = w->epoch;
+            continue;
+        }
+
+        search(*w, gen);
+    }
+}
+
+void CPUMiner::search(const WorkPackage& w, uint32_t gen) {
+    const auto header = ethash::hash256_from_bytes(w.header.data());
+    const auto boundary = ethash::hash256_from_bytes(w.boundary.data());
+    uint64_t start;
+
+    while (workGeneration() == gen && !shouldStop()) {
+        if (!nextNonces(w, m_block_multiple, start)) {
+            // Job replaced or its nonces exhausted, wait for the next one
+            heartbeat(false);
+            waitWork(gen);
+            break;
+        }
+        heartbeat();
+
+        // ethash::search_batched() stops at the first solution, go on past it
+        const uint64_t end = start + m_block_multiple;
+        for (uint64_t nonce = start; nonce != end;) {
+            auto r = ethash::search_batched(*m_context, header, boundary, nonce, end - nonce);
+            if (!r.solution_found)
+                break;
+            Farm::f().submitProof(Solution{r.nonce, h256(), w, chrono::steady_clock::now(), m_index});
+            ReportSolution(w.header, r.nonce);
+            nonce = r.nonce + 1;
+        }
+
+        updateHashRate(m_block_multiple, 1);
+    }
+}
+
+void CPUMiner::kick_miner() { wakeWork(); }
+
+void CPUMiner::enumDevices(minerMap& _DevicesCollection) {
+    unsigned numDevices = getNumDevices();
+    string modelName = getCpuModelName();
+    uint64_t totalMemory = getTotalPhysMemory();
+
+    for (unsigned i = 0; i < numDevices; i++) {
+        ostringstream s;
+        s << "cpu-" << setfill('0') << setw(2) << i;
+        string uniqueId = s.str();
+
+        DeviceDescriptor deviceDescriptor;
+        if (_DevicesCollection.find(uniqueId) != _DevicesCollection.end())
+            deviceDescriptor = _DevicesCollection[uniqueId];
+        else
+            deviceDescriptor = DeviceDescriptor();
+
+        deviceDescriptor.type = DeviceTypeEnum::Cpu;
+        deviceDescriptor.uniqueId = uniqueId;
+        deviceDescriptor.boardName = modelName;
+        deviceDescriptor.totalMemory = totalMemory;
+        deviceDescriptor.cpDetected = true;
+        deviceDescriptor.cpCpuNumber = i;
+        deviceDescriptor.cpNumaNode = CPUNuma::nodeOfCpu(i);
+
+        _DevicesCollection[uniqueId] = deviceDescriptor;
+    }
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <libdev/Worker.h>
+#include <libeth/EthashAux.h>
+#include <libeth/Miner.h>
+
+#include <ethash/ethash.hpp>
+
+#include "CPUNuma.h"
+
+#define CP_BATCH_NONCES 256 // nonces hashed between work checks
+
+namespace dev {
+namespace eth {
+class CPUMiner : public Miner {
+  public:
+    CPUMiner(unsigned _index, DeviceDescriptor& _device);
+    ~CPUMiner() override;
+
+    static unsigned getNumDevices();
+    static void enumDevices(minerMap& _DevicesCollection);
+
+    std::string dagPageMode() override { return m_dagPageMode.load(); }
+
+  protected:
+    bool initDevice() override;
+
+    bool initEpoch() override;
+
+    void kick_miner() override;
+
+  private:
+    void workLoop() override;
+
+    void bindThread();
+    void unbindThread();
+
+    void search(const WorkPackage& w, uint32_t gen);
+
+    static bool onDagProgress(int _done, int _total, void* _miner);
+
+    int m_dagProgress = 0; // Last logged DAG generation percentage
+
+    const ethash::epoch_context_full* m_context = nullptr;
+    CPUNuma::ContextPtr m_nodeContext; // Copy of the DAG on the NUMA node of this core, if any
+    std::atomic<const char*> m_dagPageMode = {""};
+};
+
+} // namespace eth
+} // namespace dev
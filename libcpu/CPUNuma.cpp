@@ -0,0 +1,114 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CPUNuma.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace {
+// Parses a sysfs list like "0-3,8-11"
+vector<unsigned> parseList(const string& _list) {
+    vector<unsigned> values;
+    size_t pos = 0;
+    while (pos < _list.size()) {
+        size_t end = _list.find(',', pos);
+        if (end == string::npos)
+            end = _list.size();
+        string range = _list.substr(pos, end - pos);
+        pos = end + 1;
+        try {
+            size_t dash = range.find('-');
+            unsigned first = stoul(range.substr(0, dash));
+            unsigned last = dash == string::npos ? first : stoul(range.substr(dash + 1));
+            for (unsigned v = first; v <= last; v++)
+                values.push_back(v);
+        } catch (const exception&) {
+            // Blank or malformed range
+        }
+    }
+    return values;
+}
+
+string readLine(const string& _path) {
+    ifstream f(_path);
+    string line;
+    getline(f, line);
+    return line;
+}
+
+struct Topology {
+    unsigned nodes = 1;
+    map<unsigned, int> cpuNodes; // cpu -> node
+
+    Topology() {
+#if defined(__linux__)
+        unsigned count = 0;
+        for (unsigned node : parseList(readLine("/sys/devices/system/node/online"))) {
+            vector<unsigned> cpus =
+                parseList(readLine("/sys/devices/system/node/node" + to_string(node) + "/cpulist"));
+            if (cpus.empty())
+                continue; // Memory only node
+            for (unsigned cpu : cpus)
+                cpuNodes[cpu] = int(node);
+            count++;
+        }
+        if (count)
+            nodes = count;
+#endif
+    }
+};
+
+const Topology& topology() {
+    static const Topology t;
+    return t;
+}
+
+struct NodeSlot {
+    mutex mtx;
+    CPUNuma::ContextPtr context;
+    int epoch = -1; // Null context for this epoch means the copy didn't fit
+};
+
+mutex s_slotsMutex;
+map<int, NodeSlot> s_slots;
+} // namespace
+
+unsigned CPUNuma::nodeCount() { return topology().nodes; }
+
+int CPUNuma::nodeOfCpu(unsigned _cpu) {
+    const Topology& t = topology();
+    auto it = t.cpuNodes.find(_cpu);
+    return it == t.cpuNodes.end() ? -1 : it->second;
+}
+
+CPUNuma::ContextPtr CPUNuma::getNodeContext(const ethash::epoch_context_full& _context, int _epoch, int _node) {
+    NodeSlot* slot;
+    {
+        lock_guard<mutex> l(s_slotsMutex);
+        slot = &s_slots[_node];
+    }
+
+    // Miners of other nodes copy their own DAG meanwhile
+    lock_guard<mutex> l(slot->mtx);
+    if (slot->epoch != _epoch) {
+        // Release the copy of the previous epoch before making the new one
+        slot->context.reset();
+        slot->context = ContextPtr(ethash::copy_epoch_context_full(_context, _node));
+        slot->epoch = _epoch;
+    }
+    return slot->context;
+}
@@ -0,0 +1,37 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <ethash/ethash.hpp>
+
+namespace dev {
+namespace eth {
+
+/// NUMA topology of the host and the node-local copies of the CPU mining DAG.
+///
+/// The topology is read once from /sys/devices/system/node. On other systems,
+/// or when the host is not NUMA, there is a single node and no copy is made.
+class CPUNuma {
+  public:
+    typedef std::shared_ptr<const ethash::epoch_context_full> ContextPtr;
+
+    static unsigned nodeCount(); // Nodes with CPUs, at least 1
+    static int nodeOfCpu(unsigned _cpu); // -1 if unknown
+
+    /// Returns the copy of the context of the epoch placed on the given node,
+    /// making it if this is the first miner of the node to ask for the epoch.
+    /// Returns null if the copy can't be allocated.
+    static ContextPtr getNodeContext(const ethash::epoch_context_full& _context, int _epoch, int _node);
+};
+
+} // namespace eth
+} // namespace dev
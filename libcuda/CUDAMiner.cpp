@@ -20,6 +20,7 @@ using namespace eth;
 CUDAMiner::CUDAMiner(unsigned _index, DeviceDescriptor& _device) : Miner("cu-", _index) {
     m_deviceDescriptor = _device;
     m_block_multiple = 1000;
+    batchController().setLimits(BATCH_TIME_MIN, CU_TARGET_BATCH_TIME);
 }
 
 CUDAMiner::~CUDAMiner() {
@@ -42,8 +43,20 @@ bool CUDAMiner::initDevice() {
     m_hwmoninfo.deviceIndex = -1; // Will be later on mapped by nvml (see Farm() constructor)
 
     try {
-        CUDA_CALL(cudaSetDevice(m_deviceDescriptor.cuDeviceIndex));
         CUDA_CALL(cudaDeviceReset());
+    } catch (const cuda_runtime_error& ec) {
+        cnote << "Could not reset CUDA device on Pci Id " << m_deviceDescriptor.uniqueId << " Error : " << ec.what();
+        cnote << "Mining aborted on this device.";
+        return false;
+    }
+    return true;
+}
+
+// The current CUDA device is per thread. Selected on every workLoop() run,
+// whether the Worker reuses its thread or starts a new one.
+bool CUDAMiner::bindThread() {
+    try {
+        CUDA_CALL(cudaSetDevice(m_deviceDescriptor.cuDeviceIndex));
     } catch (const cuda_runtime_error& ec) {
         cnote << "Could not set CUDA device on Pci Id " << m_deviceDescriptor.uniqueId << " Error : " << ec.what();
         cnote << "Mining aborted on this device.";
@@ -119,7 +132,7 @@ bool CUDAMiner::initEpoch() {
         ReportDAGDone(
             m_epochContext.dagSize,
             uint32_t(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startInit).count()),
-            true);
+            1);
     } catch (const cuda_runtime_error& ec) {
         cnote << "Unexpected error " << ec.what() << " on CUDA device " << m_deviceDescriptor.uniqueId;
         cnote << "Mining suspended ...";
@@ -132,30 +145,27 @@ bool CUDAMiner::initEpoch() {
 }
 
 void CUDAMiner::workLoop() {
-    WorkPackage last;
-    last.header = h256();
+    uint32_t gen;
 
-    if (!initDevice())
+    // A soft restart keeps the device and its DAG, the thread is bound again
+    if (!bindThread() || (!m_deviceReady && !initDevice()))
         return;
+    m_deviceReady = true;
 
     try {
         while (!shouldStop()) {
-            const WorkPackage current(work());
-            if (!current) {
-                m_hung_miner.store(false);
-                unique_lock<mutex> l(miner_work_mutex);
-                m_new_work_signal.wait_for(l, chrono::seconds(3));
+            const shared_ptr<const WorkPackage> current(work(gen));
+            if (!*current) {
+                heartbeat(false);
+                waitWork(gen);
                 continue;
             }
 
-            // Epoch change ?
-            if (current.epoch != last.epoch) {
-                setEpoch(current);
-                if (g_seqDAG)
-                    g_seqDAGMutex.lock();
-                bool b = initEpoch();
-                if (g_seqDAG)
-                    g_seqDAGMutex.unlock();
+            // Epoch change or reinit requested by the watchdog ?
+            if (current->epoch != m_dagEpoch || reinitRequested()) {
+                m_dagEpoch = -1;
+                setEpoch(*current);
+                bool b = buildEpoch();
                 if (!b)
                     break;
                 freeCache();
@@ -163,29 +173,29 @@ void CUDAMiner::workLoop() {
                 // As DAG generation takes a while we need to
                 // ensure we're on latest job, not on the one
                 // which triggered the epoch change
-                last = current;
+                m_dagEpoch = current->epoch;
                 continue;
             }
 
-            // Persist most recent job.
-            // Job's differences should be handled at higher level
-            last = current;
-
-            uint64_t upper64OfBoundary((uint64_t)(u64)((u256)current.boundary >> 192));
+            uint64_t upper64OfBoundary((uint64_t)(u64)((u256)current->boundary >> 192));
 
-            // adjust work multiplier
-            float hr = RetrieveHashRate();
-            if (hr >= 1e7)
-                m_block_multiple = uint32_t((hr * CU_TARGET_BATCH_TIME) /
-                                            (m_deviceDescriptor.cuStreamSize * m_deviceDescriptor.cuBlockSize));
+            // adjust work multiplier, the streams run concurrently
+            m_block_multiple = batchController().multiple(
+                m_block_multiple, m_deviceDescriptor.cuStreamSize * m_deviceDescriptor.cuBlockSize);
 
             // Eventually start searching
-            search(current.header.data(), upper64OfBoundary, current.startNonce, current);
+            search(current->header.data(), upper64OfBoundary, *current, gen);
         }
 
-        // Reset miner and stop working
-        CUDA_CALL(cudaDeviceReset());
+        // Reset miner and stop working, unless restarting softly
+        if (!keepDevice()) {
+            m_deviceReady = false;
+            m_dagEpoch = -1;
+            CUDA_CALL(cudaDeviceReset());
+        }
     } catch (cuda_runtime_error const& _e) {
+        m_deviceReady = false;
+        m_dagEpoch = -1;
         string _what = "GPU error: ";
         _what.append(_e.what());
         throw runtime_error(_what);
@@ -201,6 +211,7 @@ void CUDAMiner::kick_miner() {
             CUDA_CALL(cudaMemcpyAsync((uint8_t*)m_search_buf[i] + offsetof(Search_results, done), &one, sizeof(one),
                                       cudaMemcpyHostToDevice));
     }
+    wakeWork();
 }
 
 int CUDAMiner::getNumDevices() {
@@ -267,28 +278,35 @@ void CUDAMiner::enumDevices(minerMap& _DevicesCollection) {
 
 static const uint32_t zero3[3] = {0, 0, 0}; // zero the result count
 
-void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_nonce, const dev::eth::WorkPackage& w) {
+void CUDAMiner::search(uint8_t const* header, uint64_t target, const dev::eth::WorkPackage& w, uint32_t gen) {
     set_header(*((const hash32_t*)header));
     if (m_current_target != target) {
         set_target(target);
         m_current_target = target;
     }
     uint32_t batch_blocks(m_block_multiple * m_deviceDescriptor.cuBlockSize);
-    uint32_t stream_blocks(batch_blocks * m_deviceDescriptor.cuStreamSize);
+    uint64_t stream_nonce[MAX_STREAMS]; // First nonce of the batch each stream runs
+    uint32_t streams_bsy(0);
 
     m_doneMutex.lock();
     // prime each stream, clear search result buffers and start the search
-    for (uint32_t streamIdx = 0; streamIdx < m_deviceDescriptor.cuStreamSize;
-         streamIdx++, start_nonce += batch_blocks) {
+    for (uint32_t streamIdx = 0; streamIdx < m_deviceDescriptor.cuStreamSize; streamIdx++) {
+        if (!nextNonces(w, batch_blocks, stream_nonce[streamIdx]))
+            break;
         HostToDevice(m_search_buf[streamIdx], zero3, sizeof(zero3));
-        m_hung_miner.store(false);
+        heartbeat();
         run_ethash_search(m_block_multiple, m_deviceDescriptor.cuBlockSize, m_streams[streamIdx],
-                          m_search_buf[streamIdx], start_nonce);
+                          m_search_buf[streamIdx], stream_nonce[streamIdx]);
+        streams_bsy |= 1 << streamIdx;
     }
     m_done = false;
     m_doneMutex.unlock();
 
-    uint32_t streams_bsy((1 << m_deviceDescriptor.cuStreamSize) - 1);
+    // Job replaced meanwhile or its nonces exhausted, wait for the next one
+    if (!streams_bsy) {
+        heartbeat(false);
+        waitWork(gen);
+    }
 
     // process stream batches until we get new work.
 
@@ -301,8 +319,7 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
         uint32_t batchCount(0);
 
         // This inner loop will process each cuda stream individually
-        for (uint32_t streamIdx = 0; streamIdx < m_deviceDescriptor.cuStreamSize;
-             streamIdx++, start_nonce += batch_blocks) {
+        for (uint32_t streamIdx = 0; streamIdx < m_deviceDescriptor.cuStreamSize; streamIdx++) {
             uint32_t stream_mask(1 << streamIdx);
             if (!(streams_bsy & stream_mask))
                 continue;
@@ -320,12 +337,13 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
             // clear solution count, hash count and done
             HostToDevice(buffer, zero3, sizeof(zero3));
 
-            if (m_done)
+            uint64_t batch_nonce(stream_nonce[streamIdx]);
+            if (m_done || !nextNonces(w, batch_blocks, stream_nonce[streamIdx]))
                 streams_bsy &= ~stream_mask;
             else {
-                m_hung_miner.store(false);
+                heartbeat();
                 run_ethash_search(m_block_multiple, m_deviceDescriptor.cuBlockSize, stream, (Search_results*)buffer,
-                                  start_nonce);
+                                  stream_nonce[streamIdx]);
             }
 
             if (r.solCount > MAX_SEARCH_RESULTS)
@@ -333,7 +351,7 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
             batchCount += r.hashCount;
 
             for (uint32_t i = 0; i < r.solCount; i++) {
-                uint64_t nonce(start_nonce - stream_blocks + r.gid[i]);
+                uint64_t nonce(batch_nonce + r.gid[i]);
                 Farm::f().submitProof(Solution{nonce, h256(), w, chrono::steady_clock::now(), m_index});
                 ReportSolution(w.header, nonce);
             }
@@ -18,7 +18,7 @@
 #include <functional>
 
 #define MAX_STREAMS 4
-#define CU_TARGET_BATCH_TIME 0.9F // seconds
+#define CU_TARGET_BATCH_TIME 0.9F // seconds, longest batch by default
 
 namespace dev {
 namespace eth {
@@ -40,7 +40,9 @@ class CUDAMiner : public Miner {
   private:
     void workLoop() override;
 
-    void search(uint8_t const* header, uint64_t target, uint64_t _startN, const dev::eth::WorkPackage& w);
+    bool bindThread();
+
+    void search(uint8_t const* header, uint64_t target, const dev::eth::WorkPackage& w, uint32_t gen);
 
     Search_results* m_search_buf[MAX_STREAMS];
     cudaStream_t m_streams[MAX_STREAMS];
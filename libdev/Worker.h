@@ -42,6 +42,9 @@ class Worker {
     /// Whether or not this worker should stop
     bool shouldStop() const { return m_state != WorkerState::Started; }
 
+    /// Whether the worker thread is done with workLoop() and waits for a start
+    bool stopped() const { return m_state == WorkerState::Stopped; }
+
   private:
     virtual void workLoop() = 0;
 
@@ -0,0 +1,112 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "BatchController.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+void BatchController::setRisk(float _risk) {
+    lock_guard<mutex> l(m_mutex);
+    m_risk = _risk;
+}
+
+void BatchController::setLimits(float _minTime, float _maxTime) {
+    lock_guard<mutex> l(m_mutex);
+    m_minTime = _minTime;
+    m_maxTime = _maxTime;
+}
+
+void BatchController::setTuned(uint32_t _multiple) {
+    lock_guard<mutex> l(m_mutex);
+    m_tuned = _multiple;
+}
+
+void BatchController::jobArrived() {
+    lock_guard<mutex> l(m_mutex);
+    auto now = chrono::steady_clock::now();
+    if (m_lastJob.time_since_epoch().count()) {
+        float t = chrono::duration<float>(now - m_lastJob).count();
+        m_jobInterval = m_jobInterval ? m_jobInterval * (1.0f - BATCH_SMOOTHING) + t * BATCH_SMOOTHING : t;
+    }
+    m_lastJob = now;
+}
+
+void BatchController::batchDone(uint64_t _hashes) {
+    lock_guard<mutex> l(m_mutex);
+    auto now = chrono::steady_clock::now();
+
+    // Only a batch right behind another one was timed from its start
+    if (m_running && _hashes) {
+        float t = chrono::duration<float>(now - m_lastBatch).count();
+        if (t > 0.0f) {
+            float rate = float(_hashes) / t;
+            m_rate = m_rate ? m_rate * (1.0f - BATCH_SMOOTHING) + rate * BATCH_SMOOTHING : rate;
+        }
+    }
+    m_running = true;
+    m_lastBatch = now;
+}
+
+void BatchController::idle() {
+    lock_guard<mutex> l(m_mutex);
+    m_running = false;
+}
+
+uint32_t BatchController::multiple(uint32_t _current, uint32_t _itemsPerBlock) {
+    lock_guard<mutex> l(m_mutex);
+    if (!m_rate || !_itemsPerBlock)
+        return _current;
+
+    double want = double(m_rate) * targetLocked() / _itemsPerBlock;
+    // Smaller batches lose throughput, worth a longer batch up to maxTime
+    if (m_tuned)
+        want = max(want, min(double(m_tuned), double(m_rate) * m_maxTime / _itemsPerBlock));
+    if (_current)
+        want = min(max(want, _current / 2.0), _current * 2.0);
+    want = min(want, double(numeric_limits<uint32_t>::max() / _itemsPerBlock));
+    m_multiple = max(uint32_t(want), 1U);
+    m_itemsPerBlock = _itemsPerBlock;
+    return m_multiple;
+}
+
+float BatchController::target() const {
+    lock_guard<mutex> l(m_mutex);
+    return targetLocked();
+}
+
+BatchStatus BatchController::status() const {
+    lock_guard<mutex> l(m_mutex);
+    BatchStatus s;
+    s.risk = m_risk;
+    s.minTime = m_minTime;
+    s.maxTime = m_maxTime;
+    s.target = targetLocked();
+    s.jobInterval = m_jobInterval;
+    s.rate = m_rate;
+    s.multiple = m_multiple;
+    s.tuned = m_tuned;
+    if (m_rate)
+        s.batchTime = float(m_multiple) * m_itemsPerBlock / m_rate;
+    return s;
+}
+
+float BatchController::targetLocked() const {
+    if (!m_jobInterval)
+        return m_maxTime;
+    return min(max(2.0f * m_risk * m_jobInterval, m_minTime), m_maxTime);
+}
+
+} // namespace eth
+} // namespace dev
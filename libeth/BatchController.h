@@ -0,0 +1,82 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#define BATCH_STALE_RISK 0.01F // Default share of the hashing allowed to go stale on job switches
+#define BATCH_TIME_MIN 0.02F   // seconds, default shortest batch, bounds the launch overhead
+#define BATCH_TIME_MAX 1.0F    // seconds, default longest batch, backends set their own
+#define BATCH_SMOOTHING 0.2F   // Weight of a new measurement in the averages
+
+namespace dev {
+namespace eth {
+
+struct BatchStatus {
+    float risk = 0.0f;        // Settings
+    float minTime = 0.0f;
+    float maxTime = 0.0f;
+    float target = 0.0f;      // Seconds per batch aimed at
+    float batchTime = 0.0f;   // Seconds the batches of the last decision take
+    float jobInterval = 0.0f; // Seconds between jobs, 0 until measured
+    float rate = 0.0f;        // Hashes per second measured
+    uint32_t multiple = 0;    // Last decision, 0 if none yet
+    uint32_t tuned = 0;       // Smallest multiple decided, 0 if not tuned
+};
+
+/// Sizes the batches of a miner from the hash rate its kernels achieve and
+/// the rate jobs arrive at. A batch running when a job arrives is about half
+/// done, so batches of 2 * risk times the job interval lose a share risk of
+/// the hashing. The batch time is kept between minTime, below which launch
+/// overhead dominates, and maxTime, the backend's job switch latency bound.
+class BatchController {
+  public:
+    void setRisk(float _risk);
+    void setLimits(float _minTime, float _maxTime);
+    /// Smallest multiple reaching the kernel's full throughput, as measured
+    /// by tuning, 0 for none. Decisions stay above it within maxTime.
+    void setTuned(uint32_t _multiple);
+
+    // Fed by the miner
+    void jobArrived();
+    void batchDone(uint64_t _hashes);
+    void idle();
+
+    /// Blocks of _itemsPerBlock hashes for the next batches, _current until
+    /// the rate is known. Moves by a factor 2 at most per decision.
+    uint32_t multiple(uint32_t _current, uint32_t _itemsPerBlock);
+
+    float target() const;
+    BatchStatus status() const;
+
+  private:
+    float targetLocked() const;
+
+    mutable std::mutex m_mutex;
+    float m_risk = BATCH_STALE_RISK;
+    float m_minTime = BATCH_TIME_MIN;
+    float m_maxTime = BATCH_TIME_MAX;
+
+    std::chrono::steady_clock::time_point m_lastJob;
+    float m_jobInterval = 0.0f;
+
+    bool m_running = false; // m_lastBatch is the end of a batch the next one followed
+    std::chrono::steady_clock::time_point m_lastBatch;
+    float m_rate = 0.0f;
+
+    uint32_t m_multiple = 0;
+    uint32_t m_tuned = 0;
+    uint32_t m_itemsPerBlock = 0;
+};
+
+} // namespace eth
+} // namespace dev
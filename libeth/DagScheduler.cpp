@@ -0,0 +1,128 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+#include <tuple>
+
+#include "DagScheduler.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+void DagScheduler::setSlots(unsigned _slots) {
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_slots = _slots;
+    }
+    m_signal.notify_all();
+}
+
+bool DagScheduler::acquire(unsigned _miner, uint64_t _dagSize, function<bool()> const& _cancelled) {
+    unique_lock<mutex> l(m_mutex);
+
+    Build& b = build(_miner);
+    b.state = DagBuildState::Queued;
+    b.dagSize = _dagSize;
+    b.expected = b.secondsPerGB * float(_dagSize) / 1e9f;
+    b.progress = -1.0f;
+
+    while (!admissible(_miner)) {
+        m_signal.wait_for(l, chrono::seconds(1));
+        if (_cancelled()) {
+            build(_miner).state = DagBuildState::Idle;
+            l.unlock();
+            m_signal.notify_all();
+            return false;
+        }
+    }
+
+    Build& a = build(_miner);
+    a.state = DagBuildState::Building;
+    a.start = chrono::steady_clock::now();
+    m_building++;
+    return true;
+}
+
+void DagScheduler::progress(unsigned _miner, float _done) {
+    lock_guard<mutex> l(m_mutex);
+    build(_miner).progress = _done;
+}
+
+void DagScheduler::release(unsigned _miner) {
+    {
+        lock_guard<mutex> l(m_mutex);
+        Build& b = build(_miner);
+        if (b.state != DagBuildState::Building)
+            return;
+        b.state = DagBuildState::Idle;
+        b.last = chrono::duration<float>(chrono::steady_clock::now() - b.start).count();
+        if (b.dagSize)
+            b.secondsPerGB = b.last * 1e9f / float(b.dagSize);
+        m_building--;
+    }
+    m_signal.notify_all();
+}
+
+vector<DagBuildStatus> DagScheduler::status() const {
+    lock_guard<mutex> l(m_mutex);
+
+    vector<DagBuildStatus> ret;
+    auto now = chrono::steady_clock::now();
+    for (unsigned i = 0; i < m_builds.size(); i++) {
+        const Build& b = m_builds[i];
+        DagBuildStatus s;
+        s.miner = i;
+        s.state = b.state;
+        s.last = b.last;
+        if (b.state == DagBuildState::Queued)
+            s.eta = b.expected;
+        else if (b.state == DagBuildState::Building) {
+            float elapsed = chrono::duration<float>(now - b.start).count();
+            if (b.progress > 0.0f) {
+                // The measured rate beats the one of the previous build
+                s.progress = b.progress;
+                s.eta = elapsed * (1.0f - b.progress) / b.progress;
+            } else if (b.expected > 0.0f) {
+                s.progress = min(elapsed / b.expected, 1.0f);
+                s.eta = max(b.expected - elapsed, 0.0f);
+            }
+        }
+        ret.push_back(s);
+    }
+    return ret;
+}
+
+DagScheduler::Build& DagScheduler::build(unsigned _miner) {
+    if (_miner >= m_builds.size())
+        m_builds.resize(_miner + 1);
+    return m_builds[_miner];
+}
+
+bool DagScheduler::admissible(unsigned _miner) const {
+    if (!m_slots)
+        return true;
+    if (m_building >= m_slots)
+        return false;
+
+    // Shortest expected build first, the unknown ones last in index order
+    auto key = [&](unsigned i) {
+        const Build& b = m_builds[i];
+        return make_tuple(b.expected <= 0.0f, b.expected, i);
+    };
+    unsigned ahead = 0;
+    for (unsigned i = 0; i < m_builds.size(); i++)
+        if (i != _miner && m_builds[i].state == DagBuildState::Queued && key(i) < key(_miner))
+            ahead++;
+    return ahead < m_slots - m_building;
+}
+
+} // namespace eth
+} // namespace dev
@@ -0,0 +1,70 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace dev {
+namespace eth {
+
+enum class DagBuildState { Idle, Queued, Building };
+
+struct DagBuildStatus {
+    unsigned miner = 0;
+    DagBuildState state = DagBuildState::Idle;
+    float progress = 0.0f; // 0..1, measured or estimated from the expected time
+    float eta = 0.0f;      // Seconds left, 0 if unknown
+    float last = 0.0f;     // Seconds the last build took
+};
+
+/// Admits up to a given number of concurrent DAG builds. Waiting miners are
+/// admitted shortest expected build first, the expectation coming from the
+/// miner's previous build scaled to the new DAG size, so that most devices
+/// get back to hashing early. Miners never measured go in index order.
+class DagScheduler {
+  public:
+    /// 0 lets every miner build at once
+    void setSlots(unsigned _slots);
+    unsigned slots() const { return m_slots; }
+
+    /// Waits for a build slot. Returns false if _cancelled says so meanwhile.
+    bool acquire(unsigned _miner, uint64_t _dagSize, std::function<bool()> const& _cancelled);
+    void progress(unsigned _miner, float _done);
+    void release(unsigned _miner);
+
+    std::vector<DagBuildStatus> status() const;
+
+  private:
+    struct Build {
+        DagBuildState state = DagBuildState::Idle;
+        uint64_t dagSize = 0;
+        std::chrono::steady_clock::time_point start;
+        float expected = 0.0f; // Seconds, 0 if unknown
+        float progress = -1.0f; // Reported by the miner, < 0 if none
+        float secondsPerGB = 0.0f;
+        float last = 0.0f;
+    };
+
+    Build& build(unsigned _miner);
+    bool admissible(unsigned _miner) const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_signal;
+    std::vector<Build> m_builds; // Per miner index
+    unsigned m_slots = 0;
+    unsigned m_building = 0;
+};
+
+} // namespace eth
+} // namespace dev
@@ -31,9 +31,10 @@ struct EpochContext {
     int epochNumber;
     int lightNumItems;
     size_t lightSize;
-    ethash_hash512* lightCache = nullptr;
+    const ethash_hash512* lightCache = nullptr; // In light, shared by the miners of the epoch
     int dagNumItems;
     uint64_t dagSize;
+    std::shared_ptr<const ethash::epoch_context> light;
 };
 
 struct WorkPackage {
@@ -31,11 +31,19 @@ const int Farm::m_collectInterval;
 
 Farm::Farm(minerMap& _DevicesCollection, FarmSettings _settings)
     : m_Settings(move(_settings)), m_io_strand(g_io_service), m_collectTimer(g_io_service),
-      m_DevicesCollection(_DevicesCollection) {
+      m_watchdogTimer(g_io_service),
+      m_DevicesCollection(_DevicesCollection),
+      m_verifier([this](ShareVerifier::Batch const& _batch) {
+          g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _batch)));
+      }) {
     m_this = this;
+    m_dagScheduler.setSlots(m_Settings.dagSlots);
+    m_minerSolutions = vector<SolutionCounters>(m_DevicesCollection.size());
+    m_telemetry.hwmon = m_Settings.hwMon;
+    publishTelemetry();
+
     // Init HWMON if needed
     if (m_Settings.hwMon) {
-        m_telemetry.hwmon = true;
 
 #if defined(__linux)
         bool need_sysfsh = false;
@@ -121,11 +129,17 @@ Farm::Farm(minerMap& _DevicesCollection, FarmSettings _settings)
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
         m_io_strand.wrap(boost::bind(&Farm::collectData, this, boost::asio::placeholders::error)));
+
+    // Start the miners' watchdog
+    m_watchdogTimer.expires_from_now(boost::posix_time::milliseconds(WATCHDOG_INTERVAL));
+    m_watchdogTimer.async_wait(
+        m_io_strand.wrap(boost::bind(&Farm::checkMiners, this, boost::asio::placeholders::error)));
 }
 
 Farm::~Farm() {
     // Stop data collector (before monitors !!!)
     m_collectTimer.cancel();
+    m_watchdogTimer.cancel();
 
     // Deinit HWMON
 #if defined(__linux)
@@ -144,29 +158,39 @@ Farm::~Farm() {
 }
 
 void Farm::setWork(WorkPackage const& _newWp) {
-    // Set work to each miner giving it's own starting nonce
     unique_lock<mutex> l(farmWorkMutex);
 
     m_currentWp = _newWp;
 
-    // Get the randomly selected nonce
-    uint16_t segmentBits(64 - (unsigned)ceil(log2(m_miners.size())));
-    if (m_Settings.nonce.size()) {
-        segmentBits -= 4 * m_Settings.nonce.size();
-        m_currentWp.startNonce = strtoull(m_Settings.nonce.c_str(), nullptr, 16)
-                                 << (64 - (4 * m_Settings.nonce.size()));
-    } else {
-        if (m_currentWp.exSizeBytes > 0) {
-            // Equally divide the residual segment among miners
-            segmentBits -= m_currentWp.exSizeBytes * 4;
-        } else
-            m_currentWp.startNonce = uniform_int_distribution<uint64_t>()(m_engine);
+    // Close to the epoch boundary have the next light cache built in the
+    // background so the epoch change doesn't stall the miners. Most pools
+    // don't send the block number, then it is built once the epoch is known.
+    if (_newWp.epoch >= 0) {
+        int length = _newWp.block >= ethash::ecip1099_activation_block ? ethash::epoch_length_ecip1099 :
+                                                                         ethash::epoch_length;
+        if (_newWp.block < 0 || (_newWp.epoch + 1) * length - _newWp.block <= EPOCH_PREBUILD_BLOCKS)
+            ethash::prebuild_global_epoch_context(_newWp.epoch + 1);
     }
 
-    for (unsigned int i = 0; i < m_miners.size(); i++) {
-        m_miners.at(i)->setWork(m_currentWp);
-        m_currentWp.startNonce += 1ULL << segmentBits;
-    }
+    // The whole nonce space of the job, the miners take their ranges from it
+    // on demand. The high bits are fixed by --nonce or the pool extranonce.
+    unsigned bits = 64;
+    if (m_Settings.nonce.size()) {
+        bits -= 4 * m_Settings.nonce.size();
+        m_currentWp.startNonce = strtoull(m_Settings.nonce.c_str(), nullptr, 16) << bits;
+    } else if (m_currentWp.exSizeBytes > 0)
+        bits -= m_currentWp.exSizeBytes * 4;
+    else
+        m_currentWp.startNonce = uniform_int_distribution<uint64_t>()(m_engine);
+    m_nonces.reset(m_currentWp.header, m_currentWp.startNonce, bits);
+
+    // Publish one immutable copy of the job to every miner before kicking
+    // any of them so all devices switch at once
+    auto work = make_shared<const WorkPackage>(m_currentWp);
+    for (auto const& miner : m_miners)
+        miner->setWork(work);
+    for (auto const& miner : m_miners)
+        miner->kick_miner();
 }
 
 /**
@@ -200,6 +224,8 @@ bool Farm::start() {
                 if (m_Settings.clGroupSize)
                     it->second.clGroupSize = m_Settings.clGroupSize;
                 it->second.clSplit = m_Settings.clSplit;
+                it->second.clProfile = m_Settings.clProfile;
+                it->second.clAutotune = m_Settings.clAutotune;
                 m_miners.push_back(shared_ptr<Miner>(new CLMiner(m_miners.size(), it->second)));
             }
 #endif
@@ -207,12 +233,19 @@ bool Farm::start() {
 
             if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::Cpu) {
                 minerTelemetry.prefix = "cp";
+                minerTelemetry.numaNode = it->second.cpNumaNode;
                 m_miners.push_back(shared_ptr<Miner>(new CPUMiner(m_miners.size(), it->second)));
             }
 #endif
             if (minerTelemetry.prefix.empty())
                 continue;
-            m_telemetry.miners.push_back(minerTelemetry);
+            {
+                lock_guard<mutex> t(m_telemetryMutex);
+                m_telemetry.miners.push_back(minerTelemetry);
+                m_telemetryMiners++;
+                publishTelemetry();
+            }
+            m_miners.back()->batchController().setRisk(m_Settings.staleRisk);
             m_miners.back()->startWorking();
         }
 
@@ -239,12 +272,63 @@ void Farm::stop() {
                 miner->kick_miner();
             }
             m_miners.clear();
-            m_telemetry.miners.clear();
+            {
+                lock_guard<mutex> t(m_telemetryMutex);
+                m_telemetry.miners.clear();
+                m_telemetryMiners++;
+                for (auto& s : m_minerSolutions)
+                    s.reset();
+                publishTelemetry();
+            }
             m_isMining.store(false, memory_order_relaxed);
         }
     }
 }
 
+/**
+ * @brief Restarts the mining threads of the same miners. Devices keep their
+ * context, kernels and DAG, rebuilt only on a new epoch or a reinit request.
+ * The miners get FARM_RESTART_TIMEOUT to stop, waited for without the farm
+ * lock. Returns false if some didn't, those are left stopping.
+ */
+bool Farm::restartMiners() {
+    vector<shared_ptr<Miner>> miners;
+    {
+        unique_lock<mutex> l(farmWorkMutex);
+        miners = m_miners;
+        for (auto const& miner : miners) {
+            miner->setKeepDevice(true);
+            miner->triggerStopWorking();
+            miner->kick_miner();
+        }
+    }
+
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(FARM_RESTART_TIMEOUT);
+    bool stopped = true;
+    for (auto const& miner : miners) {
+        while (!miner->stopped() && chrono::steady_clock::now() < deadline)
+            this_thread::sleep_for(chrono::milliseconds(10));
+        if (!miner->stopped()) {
+            cwarn << "Miner " << miner->Index() << " did not stop within " << FARM_RESTART_TIMEOUT / 1000 << " s";
+            stopped = false;
+        }
+    }
+
+    unique_lock<mutex> l(farmWorkMutex);
+    for (auto const& miner : miners) {
+        // Stopped meanwhile, or not there any more
+        if (!miner->stopped() || find(m_miners.begin(), m_miners.end(), miner) == m_miners.end())
+            continue;
+        miner->setKeepDevice(false);
+
+        // Have a failed DAG build tried again, as a new miner would
+        miner->resume(MinerPauseEnum::PauseDueToInsufficientMemory);
+        miner->resume(MinerPauseEnum::PauseDueToInitEpochError);
+        miner->startWorking();
+    }
+    return stopped;
+}
+
 /**
  * @brief Pauses the whole collection of miners
  */
@@ -304,41 +388,41 @@ bool Farm::reboot(const vector<string>& args) {
  * @brief Account solutions for miner and for farm
  */
 void Farm::accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting) {
-    m_telemetry.farm.solutions.tstamp = chrono::steady_clock::now();
-    if (_accounting == SolutionAccountingEnum::Accepted) {
-        m_telemetry.farm.solutions.accepted++;
-        atomic_fetch_add((atomic<unsigned>*)&m_telemetry.farm.solutions.collectAcceptd, 1u);
-        m_telemetry.miners.at(_minerIdx).solutions.accepted++;
-        atomic_fetch_add((atomic<unsigned>*)&m_telemetry.miners.at(_minerIdx).solutions.collectAcceptd, 1u);
-    } else if (_accounting == SolutionAccountingEnum::Wasted) {
-        m_telemetry.farm.solutions.wasted++;
-        m_telemetry.miners.at(_minerIdx).solutions.wasted++;
-    } else if (_accounting == SolutionAccountingEnum::Rejected) {
-        m_telemetry.farm.solutions.rejected++;
-        m_telemetry.miners.at(_minerIdx).solutions.rejected++;
-    } else if (_accounting == SolutionAccountingEnum::Failed) {
-        m_telemetry.farm.solutions.failed++;
-        m_telemetry.miners.at(_minerIdx).solutions.failed++;
-    }
-    m_telemetry.miners.at(_minerIdx).solutions.tstamp = chrono::steady_clock::now();
+    m_solutions.account(_accounting);
+    if (_minerIdx < m_minerSolutions.size())
+        m_minerSolutions[_minerIdx].account(_accounting);
+
+    // Have the counts show before the next collection, without blocking the caller
+    g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::refreshTelemetry, this)));
 }
 
 /**
  * @brief Gets the solutions account for the whole farm
  */
 
-SolutionAccountType& Farm::getSolutions() { return m_telemetry.farm.solutions; }
+SolutionAccountType Farm::getSolutions() const { return m_solutions.load(); }
 
 /**
  * @brief Gets the solutions account for single miner
  */
-SolutionAccountType& Farm::getSolutions(unsigned _minerIdx) {
-    static SolutionAccountType nullSolAccount;
-    try {
-        return m_telemetry.miners.at(_minerIdx).solutions;
-    } catch (const exception&) {
-        return nullSolAccount;
-    }
+SolutionAccountType Farm::getSolutions(unsigned _minerIdx) const {
+    if (_minerIdx < m_minerSolutions.size())
+        return m_minerSolutions[_minerIdx].load();
+    return SolutionAccountType();
+}
+
+void Farm::publishTelemetry() {
+    auto t = make_shared<TelemetryType>(m_telemetry);
+    t->version = ++m_telemetry.version;
+    t->farm.solutions = m_solutions.load();
+    for (unsigned i = 0; i < t->miners.size() && i < m_minerSolutions.size(); i++)
+        t->miners[i].solutions = m_minerSolutions[i].load();
+    atomic_store(&m_telemetrySnapshot, shared_ptr<const TelemetryType>(move(t)));
+}
+
+void Farm::refreshTelemetry() {
+    lock_guard<mutex> l(m_telemetryMutex);
+    publishTelemetry();
 }
 
 void Farm::setTStartTStop(unsigned tstart, unsigned tstop) {
@@ -346,27 +430,63 @@ void Farm::setTStartTStop(unsigned tstart, unsigned tstop) {
     m_Settings.tempStop = tstop;
 }
 
-void Farm::submitProof(Solution const& _s) {
-    g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s)));
+void Farm::submitProof(Solution const& _s) { m_verifier.submit(_s); }
+
+void Farm::submitProofAsync(ShareVerifier::Batch const& _batch) {
+    for (auto const& v : _batch) {
+        Solution const& s = v.first;
+        Result const& r = v.second;
+        if (r.value > s.work.boundary) {
+            accountSolution(s.midx, SolutionAccountingEnum::Failed);
+            cwarn << "GPU " << s.midx << " gave incorrect result. Lower overclocking values if it happens frequently.";
+            continue;
+        }
+        m_onSolutionFound(s);
+
+#ifdef DEV_BUILD
+        if (g_logOptions & LOG_SUBMIT)
+            cnote << "Submit time: "
+                  << chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - s.tstamp).count()
+                  << " us.";
+#endif
+        if (s.nonce)
+            cnote << EthWhite "Solution difficulty: "
+                  << dev::getFormattedHashes(dev::getHashesToTarget(r.value.hex(HexPrefix::Add)));
+    }
 }
 
-void Farm::submitProofAsync(Solution const& _s) {
-    Result r = EthashAux::eval(_s.work.epoch, _s.work.header, _s.nonce);
-    if (r.value > _s.work.boundary) {
-        accountSolution(_s.midx, SolutionAccountingEnum::Failed);
-        cwarn << "GPU " << _s.midx << " gave incorrect result. Lower overclocking values if it happens frequently.";
+// Checks the miners' heartbeats, acting on stalls
+void Farm::checkMiners(const boost::system::error_code& ec) {
+    if (ec)
         return;
+
+    // Start() and stop() change the miners under the lock
+    vector<shared_ptr<Miner>> miners;
+    {
+        unique_lock<mutex> l(farmWorkMutex);
+        miners = m_miners;
     }
-    m_onSolutionFound(Solution{_s.nonce, r.mixHash, _s.work, _s.tstamp, _s.midx});
 
-#ifdef DEV_BUILD
-    if (g_logOptions & LOG_SUBMIT)
-        cnote << "Submit time: "
-              << chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - _s.tstamp).count() << " us.";
-#endif
-    if (_s.nonce)
-        cnote << EthWhite "Solution difficulty: "
-              << dev::getFormattedHashes(dev::getHashesToTarget(r.value.hex(HexPrefix::Add)));
+    WatchdogAction action = m_watchdog.check(miners);
+    if (action != WatchdogAction::None && g_exitOnError)
+        throw runtime_error("Hung GPU");
+    if (action == WatchdogAction::Restart) {
+        // Off the strand, a hung miner holds the restart up to its deadline.
+        // One that doesn't stop at all calls for the reboot script.
+        bool idle = false;
+        if (m_restarting.compare_exchange_strong(idle, true)) {
+            thread([this] {
+                if (!restartMiners() && !reboot({{"hung_miner_reboot"}}))
+                    cwarn << "Hung GPU detected and reboot script failed!";
+                m_restarting.store(false, memory_order_relaxed);
+            }).detach();
+        }
+    } else if (action == WatchdogAction::Reboot && !reboot({{"hung_miner_reboot"}}))
+        cwarn << "Hung GPU detected and reboot script failed!";
+
+    m_watchdogTimer.expires_from_now(boost::posix_time::milliseconds(WATCHDOG_INTERVAL));
+    m_watchdogTimer.async_wait(
+        m_io_strand.wrap(boost::bind(&Farm::checkMiners, this, boost::asio::placeholders::error)));
 }
 
 // Collects data about hashing and hardware status
@@ -374,29 +494,32 @@ void Farm::collectData(const boost::system::error_code& ec) {
     if (ec)
         return;
 
-    // check for hung miners
-    for (auto const& miner : m_miners)
-        if (!miner->paused() && miner->m_initialized) {
-            if (miner->m_hung_miner.load()) {
-                if (g_exitOnError)
-                    throw runtime_error("Hung GPU");
-                else if (!reboot({{"hung_miner_reboot"}}))
-                    cwarn << "Hung GPU " << miner->Index() << " detected and reboot script failed!";
-                return;
-            }
-            miner->m_hung_miner.store(true);
-        }
-
     // Reset hashrate (it will accumulate from miners)
     float farm_hr = 0.0f;
 
+    // Collect into a copy, the hardware queries don't hold up the writers
+    vector<shared_ptr<Miner>> miners;
+    {
+        unique_lock<mutex> l(farmWorkMutex);
+        miners = m_miners;
+    }
+    vector<TelemetryAccountType> telemetry;
+    uint64_t telemetryMiners;
+    {
+        lock_guard<mutex> l(m_telemetryMutex);
+        telemetry = m_telemetry.miners;
+        telemetryMiners = m_telemetryMiners;
+    }
+
     // Process miners
-    for (auto const& miner : m_miners) {
-        int minerIdx = miner->Index();
+    for (auto const& miner : miners) {
+        unsigned minerIdx = miner->Index();
+        if (minerIdx >= telemetry.size())
+            continue;
         float hr = (miner->paused() ? 0.0f : miner->RetrieveHashRate());
         farm_hr += hr;
-        m_telemetry.miners.at(minerIdx).hashrate = hr;
-        m_telemetry.miners.at(minerIdx).paused = miner->paused();
+        telemetry.at(minerIdx).hashrate = hr;
+        telemetry.at(minerIdx).paused = miner->paused();
 
         if (m_Settings.hwMon) {
             HwMonitorInfo hwInfo = miner->hwmonInfo();
@@ -482,15 +605,23 @@ void Farm::collectData(const boost::system::error_code& ec) {
                     miner->resume(MinerPauseEnum::PauseDueToOverHeating);
             }
 
-            m_telemetry.miners.at(minerIdx).sensors.tempC = tempC;
-            m_telemetry.miners.at(minerIdx).sensors.memtempC = memtempC;
-            m_telemetry.miners.at(minerIdx).sensors.fanP = fanpcnt;
-            m_telemetry.miners.at(minerIdx).sensors.powerW = powerW / ((double)1000.0);
+            telemetry.at(minerIdx).sensors.tempC = tempC;
+            telemetry.at(minerIdx).sensors.memtempC = memtempC;
+            telemetry.at(minerIdx).sensors.fanP = fanpcnt;
+            telemetry.at(minerIdx).sensors.powerW = powerW / ((double)1000.0);
         }
-        m_telemetry.farm.hashrate = farm_hr;
         miner->TriggerHashRateUpdate();
     }
 
+    {
+        // Miners started or stopped meanwhile are left to the next round
+        lock_guard<mutex> l(m_telemetryMutex);
+        if (m_telemetryMiners == telemetryMiners)
+            m_telemetry.miners = move(telemetry);
+        m_telemetry.farm.hashrate = farm_hr;
+        publishTelemetry();
+    }
+
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
@@ -24,7 +24,12 @@
 #include <libdev/Common.h>
 #include <libdev/Worker.h>
 
+#include <libeth/DagScheduler.h>
+#include <libeth/HostDag.h>
 #include <libeth/Miner.h>
+#include <libeth/NonceScheduler.h>
+#include <libeth/ShareVerifier.h>
+#include <libeth/Watchdog.h>
 
 #include <libhwmon/wrapnvml.h>
 #if defined(__linux)
@@ -38,6 +43,9 @@ using namespace boost::placeholders;
 
 extern boost::asio::io_service g_io_service;
 
+#define EPOCH_PREBUILD_BLOCKS 200  // Blocks before the epoch boundary to build the next light cache
+#define FARM_RESTART_TIMEOUT 10000 // milliseconds miners get to stop on a restart
+
 namespace dev {
 namespace eth {
 struct FarmSettings {
@@ -49,6 +57,10 @@ struct FarmSettings {
     unsigned cuStreams = 0;
     unsigned clGroupSize = 0;
     bool clSplit = false;
+    bool clProfile = true; // Stored tuned settings override the two above
+    bool clAutotune = false;
+    unsigned dagSlots = 0; // Concurrent DAG builds, 0 for no limit
+    float staleRisk = BATCH_STALE_RISK;
 };
 
 typedef std::map<string, DeviceDescriptor> minerMap;
@@ -67,6 +79,7 @@ class Farm {
     void setWork(WorkPackage const& _newWp);
     bool start();
     void stop();
+    bool restartMiners();
     void pause();
     bool paused();
     void resume();
@@ -74,8 +87,10 @@ class Farm {
     void restart_async();
     bool isMining() const { return m_isMining.load(std::memory_order_relaxed); }
     bool reboot(const std::vector<std::string>& args);
-    TelemetryType& Telemetry() { return m_telemetry; }
-    float HashRate() { return m_telemetry.farm.hashrate; };
+    // Latest telemetry snapshot, never changing once published. Never waits for m_telemetryMutex,
+    // std::atomic_load may take an internal lock of the library for the pointer copy only.
+    std::shared_ptr<const TelemetryType> Telemetry() const { return std::atomic_load(&m_telemetrySnapshot); }
+    float HashRate() const { return Telemetry()->farm.hashrate; };
     std::vector<std::shared_ptr<Miner>> getMiners() { return m_miners; }
     unsigned getMinersCount() { return (unsigned)m_miners.size(); };
 
@@ -88,8 +103,8 @@ class Farm {
     }
 
     void accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting);
-    SolutionAccountType& getSolutions();
-    SolutionAccountType& getSolutions(unsigned _minerIdx);
+    SolutionAccountType getSolutions() const;
+    SolutionAccountType getSolutions(unsigned _minerIdx) const;
 
     using SolutionFound = std::function<void(const Solution&)>;
     using MinerRestart = std::function<void()>;
@@ -102,18 +117,30 @@ class Farm {
     unsigned get_tstop() { return m_Settings.tempStop; }
     void submitProof(Solution const& _s);
     void set_nonce(std::string nonce) { m_Settings.nonce = nonce; }
+    NonceScheduler& nonces() { return m_nonces; }
+    ShareVerifier& verifier() { return m_verifier; }
+    Watchdog& watchdog() { return m_watchdog; }
+    DagScheduler& dagScheduler() { return m_dagScheduler; }
+    HostDagCache& hostDags() { return m_hostDags; }
     std::string get_nonce() { return m_Settings.nonce; }
 
   private:
     std::atomic<bool> m_paused = {false};
 
-    // Async submits solution serializing execution
+    // Async submits verified solutions serializing execution
     // in Farm's strand
-    void submitProofAsync(Solution const& _s);
+    void submitProofAsync(ShareVerifier::Batch const& _batch);
 
     // Collects data about hashing and hardware status
     void collectData(const boost::system::error_code& ec);
 
+    // Publishes a snapshot of m_telemetry with the solution counts, m_telemetryMutex held
+    void publishTelemetry();
+    void refreshTelemetry();
+
+    // Checks for stalled miners
+    void checkMiners(const boost::system::error_code& ec);
+
     bool spawn_file_in_bin_dir(const char* filename, const std::vector<std::string>& args);
 
     mutable std::mutex farmWorkMutex;
@@ -121,10 +148,18 @@ class Farm {
 
     WorkPackage m_currentWp;
     EpochContext m_currentEc;
+    NonceScheduler m_nonces; // Ranges of the current job handed to the miners
+    DagScheduler m_dagScheduler;
+    HostDagCache m_hostDags; // DAGs generated on the host for --cl-host-dag
 
     std::atomic<bool> m_isMining = {false};
 
+    std::mutex m_telemetryMutex;
     TelemetryType m_telemetry; // Holds progress and status info for farm and miners
+    uint64_t m_telemetryMiners = 0; // Bumped each time m_telemetry.miners is rebuilt
+    std::shared_ptr<const TelemetryType> m_telemetrySnapshot; // Only via atomic_load/store
+    SolutionCounters m_solutions;
+    std::vector<SolutionCounters> m_minerSolutions; // Per miner index, sized once
 
     SolutionFound m_onSolutionFound;
     MinerRestart m_onMinerRestart;
@@ -134,12 +169,9 @@ class Farm {
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_collectTimer;
     static const int m_collectInterval = 5000;
-
-    // StartNonce (non-NiceHash Mode) and
-    // segment width assigned to each GPU as exponent of 2
-    // considering an average block time of 15 seconds
-    // a single device GPU should need a speed of 286 Mh/s
-    // before it consumes the whole 2^32 segment
+    boost::asio::deadline_timer m_watchdogTimer;
+    Watchdog m_watchdog;
+    std::atomic<bool> m_restarting = {false}; // A watchdog restart is running
 
     // Wrappers for hardware monitoring libraries and their mappers
     wrap_nvml_handle* nvmlh = nullptr;
@@ -157,6 +189,8 @@ class Farm {
     minerMap& m_DevicesCollection;
 
     random_device m_engine;
+
+    ShareVerifier m_verifier; // Last, its threads post to the strand until destroyed
 };
 
 } // namespace eth
@@ -0,0 +1,126 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "HashRateSeries.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+uint32_t HashRateSeries::now() {
+    static const auto start = chrono::steady_clock::now();
+    return uint32_t(chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start).count()) + 1;
+}
+
+void HashRateSeries::add(uint64_t _hashes) {
+    uint32_t second = now();
+    if (second != m_second) {
+        if (m_second)
+            commit(m_second, float(m_hashes));
+        m_second = second;
+        m_hashes = 0;
+    }
+    m_hashes += _hashes;
+}
+
+void HashRateSeries::commit(uint32_t _second, float _hr) {
+    lock_guard<mutex> l(m_mutex);
+
+    // Seconds without kernel completions, e.g. during a DAG rebuild, hashed nothing
+    uint32_t from = _second > HR_SERIES_SECONDS ? _second - HR_SERIES_SECONDS + 1 : 1;
+    if (m_last)
+        from = max(from, m_last + 1);
+    else
+        from = _second;
+    for (uint32_t s = from; s < _second; s++)
+        put(s, 0.0f);
+    put(_second, _hr);
+    m_last = _second;
+}
+
+void HashRateSeries::put(uint32_t _second, float _hr) {
+    static const double alpha = 1.0 - exp(-1.0 / HR_SERIES_EWMA_TIME);
+
+    m_seconds[_second % HR_SERIES_SECONDS] = {_second, _hr};
+    m_ewma = m_last ? m_ewma + alpha * (_hr - m_ewma) : _hr;
+
+    uint32_t minute = _second / 60 + 1; // Like seconds, 0 means no sample
+    if (minute != m_minute) {
+        if (m_minuteCount)
+            m_minutes[m_minute % HR_SERIES_MINUTES] = {m_minute, float(m_minuteSum / m_minuteCount)};
+        m_minute = minute;
+        m_minuteSum = 0.0;
+        m_minuteCount = 0;
+    }
+    m_minuteSum += _hr;
+    m_minuteCount++;
+}
+
+vector<float> HashRateSeries::samples(unsigned _span, unsigned& _interval) const {
+    lock_guard<mutex> l(m_mutex);
+
+    // The running second, and minute, are not complete yet
+    int64_t end = now();
+    const Sample* ring = m_seconds.data();
+    unsigned size = HR_SERIES_SECONDS;
+    _interval = 1;
+    if (_span > HR_SERIES_SECONDS) {
+        end = end / 60 + 1;
+        ring = m_minutes.data();
+        size = HR_SERIES_MINUTES;
+        _interval = 60;
+        _span = (_span + 59) / 60;
+    }
+    _span = min(_span, size);
+
+    vector<float> ret(_span, numeric_limits<float>::quiet_NaN());
+    for (unsigned i = 0; i < _span; i++) {
+        int64_t t = end - _span + i;
+        if (t > 0 && ring[t % size].t == t)
+            ret[i] = ring[t % size].hr;
+    }
+    return ret;
+}
+
+double HashRateSeries::ewma() const {
+    lock_guard<mutex> l(m_mutex);
+    return m_ewma;
+}
+
+HashRateSeries::Stats HashRateSeries::stats(vector<float> _samples) {
+    Stats ret;
+    _samples.erase(remove_if(_samples.begin(), _samples.end(), [](float s) { return isnan(s); }), _samples.end());
+    if (_samples.empty())
+        return ret;
+
+    sort(_samples.begin(), _samples.end());
+    ret.count = unsigned(_samples.size());
+    ret.min = _samples.front();
+    ret.max = _samples.back();
+    ret.p5 = _samples[(_samples.size() - 1) * 5 / 100];
+    ret.p95 = _samples[(_samples.size() - 1) * 95 / 100];
+    return ret;
+}
+
+void HashRateSeries::accumulate(vector<float>& _total, vector<float> const& _samples) {
+    if (_total.size() < _samples.size())
+        _total.resize(_samples.size(), numeric_limits<float>::quiet_NaN());
+    for (size_t i = 0; i < _samples.size(); i++)
+        if (!isnan(_samples[i]))
+            _total[i] = isnan(_total[i]) ? _samples[i] : _total[i] + _samples[i];
+}
+
+} // namespace eth
+} // namespace dev
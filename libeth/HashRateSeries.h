@@ -0,0 +1,82 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define HR_SERIES_SECONDS 3600  // 1 second samples kept
+#define HR_SERIES_MINUTES 1440  // 1 minute rollups kept
+#define HR_SERIES_EWMA_TIME 60. // Time constant in seconds of the moving average
+
+namespace dev {
+namespace eth {
+
+/// Hashrate history of a miner in fixed memory: one sample per second for the
+/// last hour and one per minute for the last day. It is fed with the hashes of
+/// each completed kernel, a second is committed once the next one starts and
+/// seconds without any completion count as zero.
+class HashRateSeries {
+  public:
+    struct Stats {
+        double ewma = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        double p5 = 0.0;
+        double p95 = 0.0;
+        unsigned count = 0; // Samples the stats are taken from
+    };
+
+    /// Accounts the hashes of a kernel completed now. Mining thread only.
+    void add(uint64_t _hashes);
+
+    /// Hashrates of the last _span seconds ending at the last committed second,
+    /// oldest first. They are _interval = 1 second apart for spans up to
+    /// HR_SERIES_SECONDS and minute averages beyond. Missing samples are NaN.
+    std::vector<float> samples(unsigned _span, unsigned& _interval) const;
+
+    double ewma() const;
+
+    /// Stats of samples, ignoring the missing ones. ewma is left to the caller.
+    static Stats stats(std::vector<float> _samples);
+
+    /// Adds the samples of another series, as for the whole farm
+    static void accumulate(std::vector<float>& _total, std::vector<float> const& _samples);
+
+    /// Seconds since the first use, all series share the clock. 0 means no sample.
+    static uint32_t now();
+
+  private:
+    struct Sample {
+        uint32_t t = 0;
+        float hr = 0.0f;
+    };
+
+    void commit(uint32_t _second, float _hr);
+    void put(uint32_t _second, float _hr);
+
+    // Writer side, owned by the mining thread
+    uint32_t m_second = 0;
+    uint64_t m_hashes = 0;
+
+    mutable std::mutex m_mutex;
+    std::array<Sample, HR_SERIES_SECONDS> m_seconds;
+    std::array<Sample, HR_SERIES_MINUTES> m_minutes;
+    uint32_t m_last = 0; // Last committed second
+    uint32_t m_minute = 0;
+    double m_minuteSum = 0.0;
+    unsigned m_minuteCount = 0;
+    double m_ewma = 0.0;
+};
+
+} // namespace eth
+} // namespace dev
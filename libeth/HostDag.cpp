@@ -0,0 +1,127 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+
+#include <libdev/Log.h>
+
+#include "HostDag.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+HostDag::HostDag(int _epoch) : m_epoch(_epoch), m_context(ethash::get_global_epoch_context_full_shared(_epoch)) {
+    if (!m_context)
+        return;
+    m_numItems = ethash::calculate_full_dataset_num_items(_epoch);
+    m_chunkDone.resize((m_numItems + HOST_DAG_CHUNK_ITEMS - 1) / HOST_DAG_CHUNK_ITEMS, false);
+
+    unsigned threads = max(thread::hardware_concurrency(), 1U);
+    try {
+        for (unsigned i = 0; i < threads; i++)
+            m_threads.emplace_back([this] { generate(); });
+    } catch (...) {
+        // Fewer threads, at least one is needed
+        if (m_threads.empty())
+            m_context.reset();
+    }
+}
+
+HostDag::~HostDag() {
+    m_stop.store(true, memory_order_relaxed);
+    for (auto& t : m_threads)
+        t.join();
+}
+
+const uint8_t* HostDag::data() const {
+    return reinterpret_cast<const uint8_t*>(ethash_get_full_dataset(m_context.get()));
+}
+
+int HostDag::wait(int _from, function<bool()> const& _cancelled) {
+    unique_lock<mutex> l(m_mutex);
+    while (m_ready <= _from) {
+        m_signal.wait_for(l, chrono::milliseconds(100));
+        if (_cancelled())
+            return _from;
+    }
+    return m_ready;
+}
+
+// Chunks are taken in order, so the ones done from the start grow steadily
+void HostDag::generate() {
+    int chunks = int(m_chunkDone.size());
+    while (!m_stop.load(memory_order_relaxed)) {
+        int chunk = m_nextChunk.fetch_add(1, memory_order_relaxed);
+        if (chunk >= chunks)
+            return;
+        ethash_generate_full_dataset_items(m_context.get(), chunk * HOST_DAG_CHUNK_ITEMS,
+                                           (chunk + 1) * HOST_DAG_CHUNK_ITEMS);
+
+        lock_guard<mutex> l(m_mutex);
+        m_chunkDone[chunk] = true;
+        int ready = m_ready;
+        while (ready < m_numItems && m_chunkDone[ready / HOST_DAG_CHUNK_ITEMS])
+            ready = min(ready + HOST_DAG_CHUNK_ITEMS, m_numItems);
+        if (ready != m_ready) {
+            m_ready = ready;
+            m_signal.notify_all();
+        }
+    }
+}
+
+shared_ptr<HostDag> HostDagCache::get(int _epoch) {
+    unique_lock<mutex> l(m_mutex);
+    m_signal.wait(l, [this] { return !m_switching; });
+    if (m_dag && m_dag->epoch() == _epoch)
+        return m_dag;
+
+    // Free the previous DAG before allocating the next one. Its uploads run
+    // to the end, the miners move to the new epoch right after. The DAGs are
+    // released with the lock free, their deleter takes it.
+    m_switching = true;
+    shared_ptr<HostDag> previous = move(m_dag);
+    l.unlock();
+    previous.reset();
+    l.lock();
+    if (!m_signal.wait_for(l, chrono::milliseconds(HOST_DAG_RELEASE_TIMEOUT), [this] { return !m_live; }))
+        cwarn << "The previous DAG is still uploading, allocating the DAG of epoch " << _epoch << " anyway";
+    l.unlock();
+
+    shared_ptr<HostDag> dag;
+    try {
+        unique_ptr<HostDag> owned(new HostDag(_epoch));
+        l.lock();
+        m_live++;
+        l.unlock();
+        dag = shared_ptr<HostDag>(owned.release(), [this](HostDag* _dag) { release(_dag); });
+    } catch (...) {
+    }
+    if (dag && !dag->valid())
+        dag.reset();
+    if (!dag)
+        cwarn << "Not enough host memory for the DAG of epoch " << _epoch;
+
+    l.lock();
+    m_dag = dag;
+    m_switching = false;
+    m_signal.notify_all();
+    return dag;
+}
+
+void HostDagCache::release(HostDag* _dag) {
+    delete _dag;
+    lock_guard<mutex> l(m_mutex);
+    m_live--;
+    m_signal.notify_all();
+}
+
+} // namespace eth
+} // namespace dev
@@ -0,0 +1,85 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ethash/ethash.hpp>
+
+#define HOST_DAG_CHUNK_ITEMS (1 << 13)  // Items per generation task, 1 MiB of the DAG
+#define HOST_DAG_RELEASE_TIMEOUT 30000 // milliseconds the next DAG waits for the previous one to go
+
+namespace dev {
+namespace eth {
+
+/// The DAG of an epoch generated on the host, once for all the miners which
+/// upload it instead of generating it on their device. It is the dataset of
+/// the global full context the CPU miners hash on, mapped from the epoch store
+/// when there. A thread per core generates the chunks in order and the
+/// uploaders stream the part done from the start while the rest is generated.
+class HostDag {
+  public:
+    explicit HostDag(int _epoch);
+    ~HostDag();
+
+    /// False if the host memory for the DAG couldn't be allocated
+    bool valid() const { return bool(m_context); }
+    int epoch() const { return m_epoch; }
+    int numItems() const { return m_numItems; }
+    const uint8_t* data() const;
+
+    /// Waits until more than _from items from the start are generated.
+    /// Returns their count, _from if _cancelled said so meanwhile.
+    int wait(int _from, std::function<bool()> const& _cancelled);
+
+  private:
+    void generate();
+
+    int m_epoch;
+    int m_numItems = 0;
+    std::shared_ptr<const ethash::epoch_context_full> m_context;
+
+    std::vector<std::thread> m_threads;
+    std::atomic<int> m_nextChunk = {0};
+    std::atomic<bool> m_stop = {false};
+
+    std::mutex m_mutex;
+    std::condition_variable m_signal;
+    std::vector<bool> m_chunkDone;
+    int m_ready = 0; // Items generated from the start
+};
+
+/// Hands out the host DAG of an epoch. The last one is kept for the miners
+/// yet to upload it. Two DAGs rarely fit the host memory: the next epoch's
+/// waits up to HOST_DAG_RELEASE_TIMEOUT for the uploads of the previous one
+/// to end, then is allocated anyway.
+class HostDagCache {
+  public:
+    std::shared_ptr<HostDag> get(int _epoch);
+
+  private:
+    void release(HostDag* _dag);
+
+    std::mutex m_mutex;
+    std::condition_variable m_signal; // A DAG went or a switch ended
+    std::shared_ptr<HostDag> m_dag;
+    unsigned m_live = 0;     // DAGs not destroyed yet, the cache's and the ones still uploading
+    bool m_switching = false; // A get() is replacing m_dag, the others wait for it
+};
+
+} // namespace eth
+} // namespace dev
@@ -8,6 +8,13 @@
  * this file.
  */
 
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include "libpool/PoolManager.h"
 
 #include "Miner.h"
@@ -15,31 +22,29 @@
 namespace dev {
 namespace eth {
 
-DeviceDescriptor Miner::getDescriptor() { return m_deviceDescriptor; }
+static const shared_ptr<const WorkPackage> s_noWork = make_shared<const WorkPackage>();
 
-void Miner::setWork(WorkPackage const& _work) {
-    {
-        lock_guard<mutex> l(miner_work_mutex);
+DeviceDescriptor Miner::getDescriptor() { return m_deviceDescriptor; }
 
-        // Void work if this miner is paused
-        if (paused())
-            m_work.header = h256();
-        else
-            m_work = _work;
+void Miner::setWork(shared_ptr<const WorkPackage> const& _work) {
+    // Void work if this miner is paused
+    lock_guard<mutex> l(x_pause);
+    publishWork(m_pauseFlags.any() ? s_noWork : _work);
+    if (*_work)
+        m_batchController.jobArrived();
 #ifdef DEV_BUILD
-        m_workSwitchStart = chrono::steady_clock::now();
+    m_workSwitchStart = chrono::steady_clock::now();
 #endif
-    }
-    kick_miner();
 }
 
 void Miner::ReportSolution(const h256& header, uint64_t nonce) {
     cnote << EthWhite << "Job: " << header.abridged() << " Solution: " << toHex(nonce, HexPrefix::Add);
 }
 
-void Miner::ReportDAGDone(uint64_t dagSize, uint32_t dagTime, bool notSplit) {
-    cextr << dev::getFormattedMemory(float(dagSize)) << " of " << (notSplit ? "" : "(split) ")
-          << "DAG data generated in " << fixed << setprecision(1) << dagTime / 1000.0f << " seconds";
+void Miner::ReportDAGDone(uint64_t dagSize, uint32_t dagTime, unsigned parts) {
+    cextr << dev::getFormattedMemory(float(dagSize)) << " of "
+          << (parts > 1 ? "(split in " + to_string(parts) + ") " : string()) << "DAG data generated in " << fixed
+          << setprecision(1) << dagTime / 1000.0f << " seconds";
 }
 
 void Miner::ReportGPUMemoryRequired(uint32_t lightSize, uint64_t dagSize, uint32_t misc) {
@@ -58,8 +63,11 @@ void Miner::ReportGPUNoMemoryAndPause(string mem, uint64_t requiredMemory, uint6
 void Miner::pause(MinerPauseEnum what) {
     lock_guard<mutex> l(x_pause);
     m_pauseFlags.set(what);
-    m_work.header = h256();
+    publishWork(s_noWork);
     kick_miner();
+
+    // Let the running miners search the rest of our range
+    Farm::f().nonces().release(m_nonceLease);
 }
 
 bool Miner::paused() {
@@ -120,13 +128,67 @@ void Miner::TriggerHashRateUpdate() noexcept {
     m_hashRate = 0.0;
 }
 
-WorkPackage Miner::work() const {
+shared_ptr<const WorkPackage> Miner::work(uint32_t& _gen) const {
+    // The generation is read first, a job published meanwhile is seen again on the next check
+    _gen = m_workGeneration.load(memory_order_acquire);
+    return atomic_load(&m_work);
+}
+
+void Miner::publishWork(shared_ptr<const WorkPackage> const& _work) {
+    atomic_store(&m_work, _work);
+    m_workGeneration.fetch_add(1, memory_order_release);
+}
+
+// Sleeps up to 3 seconds unless a job newer than generation _gen is published
+// or the miner is kicked
+void Miner::waitWork(uint32_t _gen) {
+#if defined(__linux__)
+    static_assert(sizeof(m_workGeneration) == sizeof(uint32_t), "futex needs a plain 32 bit word");
+    struct timespec ts = {3, 0};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_workGeneration), FUTEX_WAIT_PRIVATE, _gen, &ts, nullptr, 0);
+#else
     unique_lock<mutex> l(miner_work_mutex);
-    return m_work;
+    if (m_workGeneration.load(memory_order_acquire) == _gen)
+        m_new_work_signal.wait_for(l, chrono::seconds(3));
+#endif
+}
+
+void Miner::wakeWork() {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_workGeneration), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr,
+            0);
+#else
+    m_new_work_signal.notify_all();
+#endif
+}
+
+// Takes the next _count nonces of the job, false if the job has been replaced
+bool Miner::nextNonces(WorkPackage const& _w, uint32_t _count, uint64_t& _nonce) {
+    return Farm::f().nonces().next(m_nonceLease, _w.header, _count, RetrieveHashRate(), _nonce);
+}
+
+// Called by the mining thread before each kernel, and with _busy false
+// before it waits for work or rebuilds the DAG
+void Miner::heartbeat(bool _busy) noexcept {
+    auto now = chrono::steady_clock::now().time_since_epoch().count();
+    auto last = m_heartbeat.exchange(now, memory_order_relaxed);
+
+    // Average time between kernels
+    if (_busy && m_busy.load(memory_order_relaxed)) {
+        float t = chrono::duration<float>(chrono::steady_clock::duration(now - last)).count();
+        float avg = m_batchTime.load(memory_order_relaxed);
+        m_batchTime.store(avg ? avg * 0.9f + t * 0.1f : t, memory_order_relaxed);
+    }
+    m_busy.store(_busy, memory_order_relaxed);
+    if (!_busy)
+        m_batchController.idle();
 }
 
 void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept {
     m_groupCount += _increment * _groupSize;
+    m_hashRateSeries.add(uint64_t(_increment) * _groupSize);
+    m_batchHashes.store(uint64_t(_increment) * _groupSize, memory_order_relaxed);
+    m_batchController.batchDone(uint64_t(_increment) * _groupSize);
 
     bool b = true;
     if (!m_hashRateUpdate.compare_exchange_weak(b, false))
@@ -143,21 +205,42 @@ void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept {
 }
 
 void Miner::setEpoch(WorkPackage const& w) {
-    ethash::epoch_context ec = ethash::get_global_epoch_context(w.epoch);
+    // Getting the light cache and building the DAG aren't kernels
+    heartbeat(false);
+
+    // Reference the global light cache, uploaded to the device by initEpoch()
+    m_epochContext.light = ethash::get_global_epoch_context_shared(w.epoch);
+    const ethash::epoch_context& ec = *m_epochContext.light;
     m_epochContext.epochNumber = w.epoch;
     m_epochContext.lightNumItems = ec.light_cache_num_items;
     m_epochContext.lightSize = ethash::get_light_cache_size(ec.light_cache_num_items);
     m_epochContext.dagNumItems = ec.full_dataset_num_items;
     m_epochContext.dagSize = ethash::get_full_dataset_size(ec.full_dataset_num_items);
-    m_epochContext.lightCache = new ethash_hash512[m_epochContext.lightNumItems];
-    memcpy(m_epochContext.lightCache, ec.light_cache, m_epochContext.lightSize);
+    m_epochContext.lightCache = ec.light_cache;
 }
 
-void Miner::freeCache() {
-    if (m_epochContext.lightCache) {
-        delete[] m_epochContext.lightCache;
-        m_epochContext.lightCache = nullptr;
+// Runs initEpoch() once the DAG scheduler admits this miner
+bool Miner::buildEpoch() {
+    auto& scheduler = Farm::f().dagScheduler();
+    if (!scheduler.acquire(m_index, m_epochContext.dagSize, [this] { return shouldStop(); }))
+        return false;
+    bool ret;
+    try {
+        ret = initEpoch();
+    } catch (...) {
+        scheduler.release(m_index);
+        throw;
     }
+    scheduler.release(m_index);
+    return ret;
+}
+
+void Miner::reportDagProgress(float _done) { Farm::f().dagScheduler().progress(m_index, _done); }
+
+// Drops the reference to the light cache, the cache goes once no miner needs it
+void Miner::freeCache() {
+    m_epochContext.lightCache = nullptr;
+    m_epochContext.light.reset();
 }
 
 } // namespace eth
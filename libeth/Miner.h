@@ -9,14 +9,20 @@
 
 #pragma once
 
+#include <atomic>
 #include <bitset>
 #include <condition_variable>
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <string>
 
+#include "BatchController.h"
 #include "EthashAux.h"
+#include "HashRateSeries.h"
+#include "NonceScheduler.h"
 
 #include <libdev/Common.h>
 #include <libdev/Log.h>
@@ -26,9 +32,6 @@
 
 using namespace std;
 
-extern mutex g_seqDAGMutex;
-extern bool g_seqDAG;
-
 namespace dev {
 namespace eth {
 enum class DeviceTypeEnum { Unknown, Cpu, Gpu, Accelerator };
@@ -37,10 +40,10 @@ enum class DeviceSubscriptionTypeEnum {
     None,
     OpenCL,
     Cuda,
-
+    Cpu
 };
 
-enum class MinerType { Mixed, CL, CUDA };
+enum class MinerType { Mixed, CL, CUDA, CPU };
 
 enum class HwMonitorInfoType { UNKNOWN, NVIDIA, AMD };
 
@@ -57,9 +60,8 @@ struct SolutionAccountType {
     unsigned rejected = 0;
     unsigned wasted = 0;
     unsigned failed = 0;
-    unsigned collectAcceptd = 0;
     std::chrono::steady_clock::time_point tstamp = std::chrono::steady_clock::now();
-    string str() {
+    string str() const {
         string _ret = "A" + to_string(accepted);
         if (wasted)
             _ret.append(":W" + to_string(wasted));
@@ -71,12 +73,59 @@ struct SolutionAccountType {
     };
 };
 
+/// Solution counts kept lock free, read into SolutionAccountType for telemetry
+struct SolutionCounters {
+    std::atomic<unsigned> accepted = {0};
+    std::atomic<unsigned> rejected = {0};
+    std::atomic<unsigned> wasted = {0};
+    std::atomic<unsigned> failed = {0};
+    std::atomic<std::chrono::steady_clock::rep> tstamp = {
+        std::chrono::steady_clock::now().time_since_epoch().count()};
+
+    void account(SolutionAccountingEnum _accounting) {
+        switch (_accounting) {
+        case SolutionAccountingEnum::Accepted:
+            accepted.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SolutionAccountingEnum::Rejected:
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SolutionAccountingEnum::Wasted:
+            wasted.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SolutionAccountingEnum::Failed:
+            failed.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        tstamp.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    SolutionAccountType load() const {
+        SolutionAccountType s;
+        s.accepted = accepted.load(std::memory_order_relaxed);
+        s.rejected = rejected.load(std::memory_order_relaxed);
+        s.wasted = wasted.load(std::memory_order_relaxed);
+        s.failed = failed.load(std::memory_order_relaxed);
+        s.tstamp = std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(tstamp.load(std::memory_order_relaxed)));
+        return s;
+    }
+
+    void reset() {
+        accepted.store(0, std::memory_order_relaxed);
+        rejected.store(0, std::memory_order_relaxed);
+        wasted.store(0, std::memory_order_relaxed);
+        failed.store(0, std::memory_order_relaxed);
+        tstamp.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+};
+
 struct HwSensorsType {
     int tempC = 0;
     int memtempC = 0;
     int fanP = 0;
     double powerW = 0.0;
-    string str() {
+    string str() const {
         string _ret = to_string(tempC);
         if (memtempC)
             _ret += '/' + to_string(memtempC);
@@ -123,6 +172,14 @@ struct DeviceDescriptor {
     unsigned clGroupSize;
     bool clBin;
     bool clSplit;
+    bool clProfile = false;  // Apply the settings --cl-autotune stored for the device
+    bool clAutotune = false; // Measure the best settings on the first epoch
+    bool clHostDag = false;  // Upload the DAG generated on the host
+
+    bool cpDetected; // For CPU detected devices
+    unsigned int cpCpuNumber;
+    int cpNumaNode = -1; // NUMA node of the core, -1 if unknown
+    bool cpNumaReplicate = false; // Hash against a copy of the DAG on cpNumaNode
 };
 
 struct HwMonitorInfo {
@@ -147,17 +204,20 @@ struct TelemetryAccountType {
     bool paused = false;
     HwSensorsType sensors;
     SolutionAccountType solutions;
+    int numaNode = -1; // NUMA node of CPU miners
 };
 
-/// Keeps track of progress for farm and miners
+/// Keeps track of progress for farm and miners. Published by the farm as
+/// immutable snapshots, each with a higher version.
 struct TelemetryType {
+    uint64_t version = 0;
     bool hwmon = false;
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
     TelemetryAccountType farm;
     std::vector<TelemetryAccountType> miners;
 
-    void strvec(std::list<string>& telemetry) {
+    void strvec(std::list<string>& telemetry) const {
         std::stringstream ss;
 
         /*
@@ -201,7 +261,7 @@ struct TelemetryType {
         telemetry.push_back(ss.str());
 
         int i = -1; // Current miner index
-        for (TelemetryAccountType& miner : miners) {
+        for (const TelemetryAccountType& miner : miners) {
             ss.str("");
             i++;
             hr = miner.hashrate / pow(1000.0f, magnitude);
@@ -220,7 +280,16 @@ struct TelemetryType {
         }
     };
 
-    std::string str() {
+    // Hashrate summed per NUMA node, empty if no miner is bound to a node
+    std::map<int, float> nodeHashrates() const {
+        std::map<int, float> nodes;
+        for (const TelemetryAccountType& miner : miners)
+            if (miner.numaNode >= 0)
+                nodes[miner.numaNode] += miner.hashrate;
+        return nodes;
+    }
+
+    std::string str() const {
         std::list<string> vs;
         strvec(vs);
         std::string s;
@@ -243,7 +312,7 @@ class Miner : public Worker {
     ~Miner() override = default;
 
     DeviceDescriptor getDescriptor();
-    void setWork(WorkPackage const& _work);
+    void setWork(std::shared_ptr<const WorkPackage> const& _work);
     unsigned Index() { return m_index; };
     HwMonitorInfo hwmonInfo() { return m_hwmoninfo; }
     void setHwmonDeviceIndex(int i) { m_hwmoninfo.deviceIndex = i; }
@@ -255,27 +324,63 @@ class Miner : public Worker {
     void resume(MinerPauseEnum fromwhat);
     float RetrieveHashRate() noexcept;
     void TriggerHashRateUpdate() noexcept;
+    const HashRateSeries& hashRateSeries() const { return m_hashRateSeries; }
+    BatchController& batchController() { return m_batchController; }
+    virtual std::string dagPageMode() { return std::string(); } // Host memory pages of the DAG, empty if none
+
+    // Watchdog view of the mining thread
+    std::chrono::steady_clock::time_point lastHeartbeat() const {
+        return std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(m_heartbeat.load(std::memory_order_relaxed)));
+    }
+    bool busy() const { return m_busy.load(std::memory_order_relaxed); }
+    float batchTime() const { return m_batchTime.load(std::memory_order_relaxed); } // Measured, seconds
+    float targetBatchTime() const { return m_batchController.target(); }            // Aimed at, seconds
+    // The last batch's hashes at the hashrate average, seconds, 0 until known. Unlike batchTime()
+    // it follows a batch resized by the controller and lags a burst of short kernels.
+    float expectedBatchTime() const {
+        double ewma = m_hashRateSeries.ewma();
+        return ewma > 0.0 ? float(m_batchHashes.load(std::memory_order_relaxed) / ewma) : 0.0f;
+    }
+    void requestReinit() { m_reinit.store(true, std::memory_order_relaxed); }
 
-    std::atomic<bool> m_hung_miner = {false};
-    bool m_initialized = false;
+    // Soft restart: the mining thread stopping meanwhile leaves the device
+    // context and DAG in place for the next workLoop() to reuse
+    void setKeepDevice(bool _keep) { m_keepDevice.store(_keep, std::memory_order_relaxed); }
+
+    std::atomic<bool> m_initialized = {false}; // Set by the mining thread, read by the watchdog
 
   protected:
     virtual bool initDevice() = 0;
     virtual bool initEpoch() = 0;
     void setEpoch(WorkPackage const& _newWp);
+    bool buildEpoch();
+    void reportDagProgress(float _done);
     void freeCache();
 
-    WorkPackage work() const;
+    // Latest job published to the miner, never null, _gen receives its generation. Checking
+    // workGeneration() is lock free, the job is loaded with std::atomic_load, which may take an
+    // internal lock of the library, only when it changed.
+    std::shared_ptr<const WorkPackage> work(uint32_t& _gen) const;
+    uint32_t workGeneration() const { return m_workGeneration.load(std::memory_order_acquire); }
+    void waitWork(uint32_t _gen);
+    void wakeWork();
+    bool nextNonces(WorkPackage const& _w, uint32_t _count, uint64_t& _nonce);
     void ReportSolution(const h256& header, uint64_t nonce);
-    void ReportDAGDone(uint64_t dagSize, uint32_t dagTime, bool notSplit);
+    void ReportDAGDone(uint64_t dagSize, uint32_t dagTime, unsigned parts);
     void ReportGPUNoMemoryAndPause(std::string mem, uint64_t requiredTotalMemory, uint64_t totalMemory);
     void ReportGPUMemoryRequired(uint32_t lightSize, uint64_t dagSize, uint32_t misc);
     void updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept;
+    void heartbeat(bool _busy = true) noexcept;
+    bool reinitRequested() { return m_reinit.exchange(false, std::memory_order_relaxed); }
+    bool keepDevice() const { return m_keepDevice.load(std::memory_order_relaxed); }
 
     const unsigned m_index = 0;          // Ordinal index of the Instance (not the device)
     DeviceDescriptor m_deviceDescriptor; // Info about the device
 
     EpochContext m_epochContext;
+    bool m_deviceReady = false; // initDevice() done, survives soft restarts
+    int m_dagEpoch = -1;        // Epoch of the DAG on the device, -1 if none
 
 #ifdef DEV_BUILD
     std::chrono::steady_clock::time_point m_workSwitchStart;
@@ -291,12 +396,26 @@ class Miner : public Worker {
   private:
     bitset<MinerPauseEnum::Pause_MAX> m_pauseFlags;
 
-    WorkPackage m_work;
+    void publishWork(std::shared_ptr<const WorkPackage> const& _work);
+
+    std::shared_ptr<const WorkPackage> m_work = std::make_shared<const WorkPackage>(); // Only via atomic_load/store
+    std::atomic<uint32_t> m_workGeneration = {0}; // Bumped on each job published
 
     std::chrono::steady_clock::time_point m_hashTime = std::chrono::steady_clock::now();
     std::atomic<float> m_hashRate = {0.0};
     atomic<bool> m_hashRateUpdate = {false};
     uint64_t m_groupCount = 0;
+    HashRateSeries m_hashRateSeries;
+    BatchController m_batchController;
+    NonceScheduler::Lease m_nonceLease;
+
+    std::atomic<std::chrono::steady_clock::rep> m_heartbeat = {
+        std::chrono::steady_clock::now().time_since_epoch().count()};
+    std::atomic<bool> m_busy = {false}; // Beating between kernels, not waiting
+    std::atomic<float> m_batchTime = {0.0f};
+    std::atomic<uint64_t> m_batchHashes = {0};
+    std::atomic<bool> m_reinit = {false};
+    std::atomic<bool> m_keepDevice = {false};
 };
 
 } // namespace eth
@@ -0,0 +1,101 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+
+#include "NonceScheduler.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+void NonceScheduler::reset(const h256& _header, uint64_t _start, unsigned _bits) {
+    lock_guard<mutex> l(m_mutex);
+
+    uint64_t size = _bits < 64 ? (1ULL << _bits) : ~0ULL;
+    if (_header == m_header && _start == m_start && size == m_size)
+        return;
+
+    m_header = _header;
+    m_start = _start;
+    m_size = size;
+    m_cursor = 0;
+    m_returned.clear();
+    m_generation.fetch_add(1, memory_order_release);
+}
+
+bool NonceScheduler::next(Lease& _lease, const h256& _header, uint32_t _count, float _hashrate, uint64_t& _nonce) {
+    if (!_count)
+        return false;
+
+    lock_guard<mutex> ll(_lease.m_mutex);
+
+    // A lease of an older job is void, its ranges were never handed out again
+    if (_lease.m_generation != m_generation.load(memory_order_acquire) || _lease.m_header != _header)
+        _lease.m_range = Range();
+    if (_lease.m_range.count < _count && !refill(_lease, _header, _count, _hashrate))
+        return false;
+
+    _nonce = _lease.m_start + _lease.m_range.offset;
+    _lease.m_range.offset += _count;
+    _lease.m_range.count -= _count;
+    return true;
+}
+
+void NonceScheduler::release(Lease& _lease) {
+    lock_guard<mutex> ll(_lease.m_mutex);
+    lock_guard<mutex> l(m_mutex);
+    giveBack(_lease);
+}
+
+// Called with the lease locked
+bool NonceScheduler::refill(Lease& _lease, const h256& _header, uint32_t _count, float _hashrate) {
+    lock_guard<mutex> l(m_mutex);
+
+    if (_header != m_header)
+        return false;
+    giveBack(_lease);
+
+    // Lease whole batches worth NONCE_LEASE_TIME at the miner's speed
+    uint64_t want = max<uint64_t>(uint64_t(_hashrate * NONCE_LEASE_TIME) / _count, NONCE_LEASE_BATCHES) * _count;
+
+    // Returned ranges first, skipping those smaller than a batch
+    Range& lease = _lease.m_range;
+    auto it = find_if(m_returned.begin(), m_returned.end(), [&](const Range& r) { return r.count >= _count; });
+    if (it != m_returned.end()) {
+        lease.offset = it->offset;
+        lease.count = min(want, it->count / _count * _count);
+        it->offset += lease.count;
+        it->count -= lease.count;
+        if (!it->count)
+            m_returned.erase(it);
+    } else {
+        if (m_size - m_cursor < _count)
+            return false;
+        lease.offset = m_cursor;
+        lease.count = min(want, (m_size - m_cursor) / _count * _count);
+        m_cursor += lease.count;
+    }
+
+    _lease.m_generation = m_generation.load(memory_order_relaxed);
+    _lease.m_header = m_header;
+    _lease.m_start = m_start;
+    return true;
+}
+
+// Called with both locks held. Ranges of an older job are dropped.
+void NonceScheduler::giveBack(Lease& _lease) {
+    if (_lease.m_range.count && _lease.m_generation == m_generation.load(memory_order_relaxed))
+        m_returned.push_back(_lease.m_range);
+    _lease.m_range = Range();
+}
+
+} // namespace eth
+} // namespace dev
@@ -0,0 +1,79 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+
+#include <libdev/FixedHash.h>
+
+#define NONCE_LEASE_TIME 1.0F  // seconds of hashing handed to a miner at once
+#define NONCE_LEASE_BATCHES 16 // fewest batches handed to a miner at once
+
+namespace dev {
+namespace eth {
+
+/// Hands out the nonces of the current job to the miners on demand.
+///
+/// The search space of a job is [start, start + 2^bits), the high bits of start
+/// hold the pool extranonce or the --nonce prefix. Each miner leases about
+/// NONCE_LEASE_TIME seconds of nonces at its measured hashrate, and at least
+/// NONCE_LEASE_BATCHES batches, and takes its batches from the lease, so fast
+/// and slow miners share the space without overlap whatever their count. The
+/// lease is the miner's own, only refills take the scheduler's lock. Unused
+/// leases are given back and handed out again first to the miners whose
+/// batches fit in them.
+class NonceScheduler {
+    struct Range {
+        uint64_t offset = 0; // From the start of the job
+        uint64_t count = 0;
+    };
+
+  public:
+    /// Nonces of a job held by one miner
+    class Lease {
+        friend class NonceScheduler;
+
+        std::mutex m_mutex; // Taken by the mining thread and by pause()
+        uint64_t m_generation = 0;
+        h256 m_header;
+        uint64_t m_start = 0;
+        Range m_range;
+    };
+
+    /// Starts the search space of a new job. Resetting the same job keeps the
+    /// ranges already handed out.
+    void reset(const h256& _header, uint64_t _start, unsigned _bits);
+
+    /// Takes the next _count nonces of the job from the miner's lease, starting
+    /// at _nonce. Returns false if the job has been replaced or its space is
+    /// exhausted.
+    bool next(Lease& _lease, const h256& _header, uint32_t _count, float _hashrate, uint64_t& _nonce);
+
+    /// Gives back the rest of the miner's lease, e.g. when it is paused.
+    void release(Lease& _lease);
+
+  private:
+    bool refill(Lease& _lease, const h256& _header, uint32_t _count, float _hashrate);
+    void giveBack(Lease& _lease);
+
+    std::mutex m_mutex;
+    std::atomic<uint64_t> m_generation = {0}; // Bumped by each new job, voids the leases
+
+    h256 m_header;
+    uint64_t m_start = 0;
+    uint64_t m_size = 0; // Nonces in the job, saturated at 2^64 - 1
+    uint64_t m_cursor = 0; // Offset of the first nonce never handed out
+    std::list<Range> m_returned;
+};
+
+} // namespace eth
+} // namespace dev
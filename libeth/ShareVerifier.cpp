@@ -0,0 +1,95 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+
+#include <libdev/Log.h>
+
+#include "ShareVerifier.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+ShareVerifier::ShareVerifier(Handler _handler) : m_handler(move(_handler)) {
+    unsigned threads = min(max(thread::hardware_concurrency() / 2, 1U), unsigned(VERIFY_THREADS_MAX));
+    for (unsigned i = 0; i < threads; i++)
+        m_threads.emplace_back(&ShareVerifier::workLoop, this);
+}
+
+ShareVerifier::~ShareVerifier() {
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_stop = true;
+    }
+    m_signal.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+
+    // The handler's owner is going away, results handed over now would
+    // never be submitted
+    if (!m_queue.empty())
+        cwarn << m_queue.size() << " solution(s) dropped unverified on shutdown";
+}
+
+void ShareVerifier::submit(Solution const& _s) {
+    {
+        unique_lock<mutex> l(m_mutex);
+        if (m_queue.size() < VERIFY_QUEUE_DEPTH) {
+            m_queue.push_back(_s);
+            m_depth.store(unsigned(m_queue.size()), memory_order_relaxed);
+            l.unlock();
+            m_signal.notify_one();
+            return;
+        }
+    }
+
+    // Verifiers saturated, don't lose the share
+    m_handler(Batch{verify(_s)});
+}
+
+void ShareVerifier::workLoop() {
+    Batch batch;
+    vector<Solution> candidates;
+
+    while (true) {
+        {
+            unique_lock<mutex> l(m_mutex);
+            m_signal.wait(l, [&] { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                return;
+
+            // Take what is queued, up to a batch, leaving the rest to the other threads
+            size_t n = min(m_queue.size(), size_t(VERIFY_BATCH));
+            candidates.assign(m_queue.begin(), m_queue.begin() + n);
+            m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+            m_depth.store(unsigned(m_queue.size()), memory_order_relaxed);
+        }
+
+        batch.clear();
+        for (auto const& s : candidates)
+            batch.push_back(verify(s));
+        m_handler(batch);
+    }
+}
+
+pair<Solution, Result> ShareVerifier::verify(Solution const& _s) {
+    Result r = EthashAux::eval(_s.work.epoch, _s.work.header, _s.nonce);
+
+    float us = float(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - _s.tstamp).count());
+    float avg = m_latency.load(memory_order_relaxed);
+    while (!m_latency.compare_exchange_weak(avg, avg ? avg * 0.9f + us * 0.1f : us, memory_order_relaxed))
+        ;
+
+    return {Solution{_s.nonce, r.mixHash, _s.work, _s.tstamp, _s.midx}, r};
+}
+
+} // namespace eth
+} // namespace dev
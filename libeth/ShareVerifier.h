@@ -0,0 +1,68 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "EthashAux.h"
+
+#define VERIFY_THREADS_MAX 4  // Upper bound of share verification threads
+#define VERIFY_QUEUE_DEPTH 64 // Candidates queued before the miners verify their own
+#define VERIFY_BATCH 8        // Candidates verified before handing the results over
+
+namespace dev {
+namespace eth {
+
+/// Evaluates the solutions found by the miners on a small pool of threads so
+/// the light hash of every candidate doesn't hold the io strand. Results are
+/// handed over in batches to the handler, which decides what to submit.
+///
+/// The queue is bounded. When it is full the finding miner evaluates its own
+/// candidate, slowing it down rather than dropping a share.
+class ShareVerifier {
+  public:
+    using Batch = std::vector<std::pair<Solution, Result>>;
+    using Handler = std::function<void(Batch const&)>;
+
+    explicit ShareVerifier(Handler _handler);
+    ~ShareVerifier();
+
+    void submit(Solution const& _s);
+
+    unsigned queueDepth() const { return m_depth.load(std::memory_order_relaxed); }
+
+    /// Average time in microseconds from a solution being found to its evaluation
+    unsigned latency() const { return unsigned(m_latency.load(std::memory_order_relaxed)); }
+
+  private:
+    void workLoop();
+    std::pair<Solution, Result> verify(Solution const& _s);
+
+    Handler m_handler;
+
+    std::mutex m_mutex;
+    std::condition_variable m_signal;
+    std::deque<Solution> m_queue;
+    std::atomic<unsigned> m_depth = {0};
+    std::atomic<float> m_latency = {0.0f};
+    bool m_stop = false;
+
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace eth
+} // namespace dev
@@ -0,0 +1,112 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+
+#include "Watchdog.h"
+
+using namespace std;
+
+namespace dev {
+namespace eth {
+
+WatchdogAction Watchdog::check(vector<shared_ptr<Miner>> const& _miners) {
+    lock_guard<mutex> l(m_mutex);
+
+    WatchdogAction ret = WatchdogAction::None;
+    auto now = chrono::steady_clock::now();
+
+    for (auto const& miner : _miners) {
+        unsigned index = miner->Index();
+        if (index >= m_miners.size())
+            m_miners.resize(index + 1);
+        Tracking& t = m_miners[index];
+
+        float batch = max({miner->targetBatchTime(), miner->batchTime(), miner->expectedBatchTime()});
+        float limit = max(WATCHDOG_STALL_MIN, WATCHDOG_STALL_BATCHES * batch);
+        float silence = chrono::duration<float>(now - miner->lastHeartbeat()).count();
+
+        // Idle miners, waiting for work or building a DAG, don't beat
+        if (!miner->busy() || !miner->m_initialized || miner->paused() || silence <= limit) {
+            if (t.stalled) {
+                t.stalled = false;
+                StallRecord* r = findRecord(t.record);
+                if (r) {
+                    r->recovered = true;
+                    cnote << "Miner " << index << " recovered after a " << fixed << setprecision(1) << r->seconds
+                          << " s stall";
+                }
+            }
+            continue;
+        }
+
+        StallRecord* r = t.stalled ? findRecord(t.record) : nullptr;
+        if (!r) {
+            StallRecord s;
+            s.miner = index;
+            s.start = chrono::system_clock::now() -
+                      chrono::duration_cast<chrono::system_clock::duration>(now - miner->lastHeartbeat());
+            m_history.push_back(s);
+            if (m_history.size() > WATCHDOG_HISTORY) {
+                m_history.pop_front();
+                m_firstId++;
+            }
+            t.stalled = true;
+            t.record = m_firstId + unsigned(m_history.size()) - 1;
+            r = &m_history.back();
+        }
+        r->seconds = silence;
+
+        // One more action each stall limit
+        auto due = WatchdogAction(min(int(silence / limit), int(WatchdogAction::Reboot)));
+        if (due <= r->action)
+            continue;
+        r->action = due;
+        ret = max(ret, due);
+
+        cwarn << "Miner " << index << " stalled, no heartbeat for " << fixed << setprecision(1) << silence
+              << " s, action: " << actionName(due);
+        // Restarts keep the device buffers, have the stalled ones rebuilt
+        if (due >= WatchdogAction::Reinit)
+            miner->requestReinit();
+        if (due <= WatchdogAction::Reinit)
+            miner->kick_miner();
+    }
+
+    return ret;
+}
+
+vector<StallRecord> Watchdog::history() const {
+    lock_guard<mutex> l(m_mutex);
+    return vector<StallRecord>(m_history.begin(), m_history.end());
+}
+
+const char* Watchdog::actionName(WatchdogAction _action) {
+    switch (_action) {
+    case WatchdogAction::Kick:
+        return "kick";
+    case WatchdogAction::Reinit:
+        return "reinit";
+    case WatchdogAction::Restart:
+        return "restart";
+    case WatchdogAction::Reboot:
+        return "reboot";
+    default:
+        return "none";
+    }
+}
+
+StallRecord* Watchdog::findRecord(unsigned _id) {
+    if (_id < m_firstId || _id - m_firstId >= m_history.size())
+        return nullptr;
+    return &m_history[_id - m_firstId];
+}
+
+} // namespace eth
+} // namespace dev
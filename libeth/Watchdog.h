@@ -0,0 +1,70 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Miner.h"
+
+#define WATCHDOG_INTERVAL 250     // milliseconds between heartbeat checks
+#define WATCHDOG_STALL_MIN 2.0F   // seconds, shortest silence taken as a stall
+#define WATCHDOG_STALL_BATCHES 10 // batch times without heartbeat taken as a stall
+#define WATCHDOG_HISTORY 64       // stalls remembered
+
+namespace dev {
+namespace eth {
+
+// Escalating responses to a stall, one more each stall limit it lasts
+enum class WatchdogAction { None, Kick, Reinit, Restart, Reboot };
+
+struct StallRecord {
+    unsigned miner = 0;
+    std::chrono::system_clock::time_point start; // Time of the last heartbeat
+    float seconds = 0.0f;                        // So far, or in total once recovered
+    WatchdogAction action = WatchdogAction::None; // Strongest action taken
+    bool recovered = false;
+};
+
+/// Detects stalled miners from their heartbeats. A busy miner is stalled when
+/// it misses WATCHDOG_STALL_BATCHES times its batch time, the largest of the
+/// batch controller's target, the measured one and the one expected from its
+/// hashrate average. The watchdog kicks it then
+/// has it reinitialize its device, the farm restart and finally the reboot
+/// script run, as long as the stall lasts.
+class Watchdog {
+  public:
+    /// Checks the heartbeats and acts on the miners. Returns the farm wide
+    /// action to take, if any.
+    WatchdogAction check(std::vector<std::shared_ptr<Miner>> const& _miners);
+
+    std::vector<StallRecord> history() const;
+
+    static const char* actionName(WatchdogAction _action);
+
+  private:
+    struct Tracking {
+        bool stalled = false;
+        unsigned record = 0; // Id of the open stall record
+    };
+
+    StallRecord* findRecord(unsigned _id);
+
+    mutable std::mutex m_mutex;
+    std::vector<Tracking> m_miners; // Per miner index
+    std::deque<StallRecord> m_history;
+    unsigned m_firstId = 0; // Id of m_history.front()
+};
+
+} // namespace eth
+} // namespace dev
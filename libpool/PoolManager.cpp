@@ -28,13 +28,13 @@ PoolManager::PoolManager(PoolSettings _settings)
     Farm::f().onMinerRestart([&]() {
         cnote << "Restart miners...";
 
-        if (Farm::f().isMining()) {
-            cnote << "Shutting down miners...";
-            Farm::f().stop();
+        // Keep the miners and their DAGs, only what is invalid gets rebuilt
+        if (Farm::f().isMining())
+            Farm::f().restartMiners();
+        else {
+            cnote << "Spinning up miners...";
+            Farm::f().start();
         }
-
-        cnote << "Spinning up miners...";
-        Farm::f().start();
     });
 
     Farm::f().onSolutionFound([&](const Solution& sol) {